@@ -30,6 +30,182 @@
 
 // Headers
 #include "data.h"
+#include "stitch.h"
+#include "fit.h"
+#include <algorithm>
+
+
+//
+// Work partitioning
+//
+
+// Coordinates (uniform work, in blocks of whole points)
+static const Partitioner PARTITION_COORDINATES(TRANSFORM_BLOCK, SCHEDULE_STATIC, 4*TRANSFORM_BLOCK);
+
+// Blocks of coordinates
+static const Partitioner PARTITION_BLOCKS(1, SCHEDULE_STATIC, 4);
+
+// Elements (work varies with their length)
+static const Partitioner PARTITION_ELEMENTS(16, SCHEDULE_DYNAMIC, 64);
+
+
+//
+// Levels of detail
+//
+
+// Slot of an element which is no simpler than on the previous level
+static const unsigned int DETAIL_NONE = (unsigned int)-1;
+
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+//
+// Simplification
+//
+
+// Sequential simplification: a point is kept if any point since the last kept one lies further
+// than the radius from the line towards it (quadratic in the amount of dropped points)
+static unsigned int help_simplify_sequential(double* parameters, unsigned int size, double radius, vector<double>& result)
+{
+	result.clear();
+	result.reserve(size);
+
+	// Define last point
+	double lastX = parameters[0];
+	double lastY = parameters[1];
+	double lastI = 0;
+
+	// Starting point should always go on the result
+	result.push_back(lastX);
+	result.push_back(lastY);
+
+	// Loop other points
+	for (unsigned int i = 4; i < size; i+=2)
+	{
+		// Define current point
+		double curX = parameters[i];
+		double curY = parameters[i+1];
+
+		// Calculate primary vector coefficients
+		double lineX = curX - lastX;
+		double lineY = curY - lastY;
+
+		// Loop all points in between
+		bool falls_in_between = true;
+		for (unsigned int j = lastI+2; j < i-2 && falls_in_between; j+=2)
+		{
+			// Calculate distance from point to line through secondary vector coefficients (dot product)
+			double pointX = parameters[j] - lastX;
+			double pointY = parameters[j+1] - lastY;
+			double dist = abs(pointX * lineY - lineX * pointY) / sqrt(lineX * lineX + lineY * lineY);
+
+			// Check distance
+			if (dist > radius)
+				falls_in_between = false;
+		}
+
+		if (!falls_in_between)
+		{
+			result.push_back(curX);
+			result.push_back(curY);
+
+			lastX = curX;
+			lastY = curY;
+			lastI = i;
+		}
+	}
+
+	// And add the final point
+	result.push_back(parameters[size-2]);
+	result.push_back(parameters[size-1]);
+
+	// Save the result in place (it never outgrows the original)
+	if (result.size() > size)
+		return size;
+	std::copy(result.begin(), result.end(), parameters);
+	return result.size();
+}
+
+// Douglas-Peucker simplification: every range keeps its point furthest from the chord between its
+// end points if that one lies further than the radius, and gets split there (measuring the distance
+// to the chord as a segment rather than a line bounds the distance of every dropped point to the result)
+static unsigned int help_simplify_douglas_peucker(double* parameters, unsigned int size, double radius, vector<unsigned int>& stack, bool segments = false)
+{
+	unsigned int points = size / 2;
+	if (points < 3)
+		return size;
+
+	// Process ranges left to right with an explicit stack, so the kept points come out in order
+	//   and can be compacted in place (a range never reads before its first point, which has
+	//   already been written out)
+	unsigned int target = 2;
+	stack.clear();
+	stack.push_back(0);
+	stack.push_back(points-1);
+	double limit = radius * radius;
+	while (!stack.empty())
+	{
+		unsigned int last = stack.back();
+		stack.pop_back();
+		unsigned int first = stack.back();
+		stack.pop_back();
+
+		// Calculate chord coefficients
+		double firstX = parameters[2*first];
+		double firstY = parameters[2*first+1];
+		double lineX = parameters[2*last] - firstX;
+		double lineY = parameters[2*last+1] - firstY;
+		double length = lineX * lineX + lineY * lineY;
+
+		// Find the furthest point (comparing squared distances, scaled by the squared chord length)
+		double furthest = -1;
+		unsigned int index = first;
+		for (unsigned int i = first + 1; i < last; i++)
+		{
+			double pointX = parameters[2*i] - firstX;
+			double pointY = parameters[2*i+1] - firstY;
+			double distance;
+			double dot = pointX * lineX + pointY * lineY;
+			if (length > 0 && segments && dot < 0)
+				distance = (pointX * pointX + pointY * pointY) * length;
+			else if (length > 0 && segments && dot > length)
+				distance = ((pointX - lineX) * (pointX - lineX) + (pointY - lineY) * (pointY - lineY)) * length;
+			else if (length > 0)
+			{
+				double cross = pointX * lineY - lineX * pointY;
+				distance = cross * cross;
+			}
+			else
+				distance = pointX * pointX + pointY * pointY;
+			if (distance > furthest)
+			{
+				furthest = distance;
+				index = i;
+			}
+		}
+
+		// Split the range if that point lies outside the radius (left half first)
+		if (index != first && furthest > limit * (length > 0 ? length : 1))
+		{
+			stack.push_back(index);
+			stack.push_back(last);
+			stack.push_back(first);
+			stack.push_back(index);
+		}
+
+		// Otherwise drop all points in between
+		else
+		{
+			parameters[target++] = parameters[2*last];
+			parameters[target++] = parameters[2*last+1];
+		}
+	}
+
+	return target;
+}
 
 
 
@@ -41,7 +217,7 @@
 // Construction and destruction
 //
 
-Data::Data()
+Data::Data() : dataGeneration(0), detailCount(0)
 {
 	clear();
 }
@@ -58,9 +234,15 @@ void Data::clear()
 
 	// Cache reset
 	cacheBoundsDirty = true;
+	cacheTransformedDirty = true;
+	dataIndex.invalidate();
+	dropDetail();
 
 	// Delete dataElements
 	dataElements.clear();
+	dataTransform = Affine();
+	dataWidest = 0;
+	dataGeneration++;
 }
 
 
@@ -68,93 +250,112 @@ void Data::clear()
 // Element input
 //
 
+// Allocate room for a given amount of elements and parameters
+void Data::reserve(unsigned int elements, unsigned int parameters)
+{
+	dataElements.reserve(elements, parameters);
+}
+
 // Single point
 void Data::addPoint(int x1, int y1)
 {
-	addPoint(x1, y1, dataElements.end());
+	addPoint(x1, y1, dataElements.size());
 }
-void Data::addPoint(int x1, int y1, list<Element>::iterator it)
+void Data::addPoint(int x1, int y1, unsigned int position)
 {
-    // Extend the list
-	Element dummy;
-	setPoint(x1, y1, dataElements.insert(it, dummy));
+	insertElement(position);
+	setPoint(x1, y1, position);
 }
-void Data::setPoint(int x1, int y1, list<Element>::iterator it)
+void Data::setPoint(int x1, int y1, unsigned int position)
 {
-	// New element
-	Element tempElement;
-	tempElement.identifier = 1;
-
 	// Save parameters
-	tempElement.parameters.resize(2);
-	tempElement.parameters[0] = x1;
-	tempElement.parameters[1] = y1;
+	double parameters[2];
+	parameters[0] = x1;
+	parameters[1] = y1;
 
 	// Save the element
-	setElement(tempElement, it);
+	setElement(1, parameters, 2, position);
 }
 
 // Polyline
 void Data::addPolyline(const vector<double>& points)
 {
-	addPolyline(points, dataElements.end());
+	addPolyline(points, dataElements.size());
 }
-void Data::addPolyline(const vector<double>& points, list<Element>::iterator it)
+void Data::addPolyline(const double* points, unsigned int count)
 {
-    // Extend the list
-	Element dummy;
-	setPolyline(points, dataElements.insert(it, dummy));
+	unsigned int position = dataElements.size();
+	insertElement(position);
+	setElement(2, points, count, position);
 }
-void Data::setPolyline(const vector<double>& points, list<Element>::iterator it)
+void Data::addPolyline(const vector<double>& points, unsigned int position)
 {
-	// New element
-	Element tempElement;
-	tempElement.identifier = 2;
-
-	// Save parameters
-	tempElement.parameters = points;
-
-	// Save the element
-	setElement(tempElement, it);
+	insertElement(position);
+	setPolyline(points, position);
+}
+void Data::setPolyline(const vector<double>& points, unsigned int position)
+{
+	setElement(2, points.empty() ? 0 : &points[0], points.size(), position);
 }
 
 // Add a new polybezier
 void Data::addPolybezier(const vector<double>& points)
 {
-	addPolybezier(points, dataElements.end());
+	addPolybezier(points, dataElements.size());
 }
-void Data::addPolybezier(const vector<double>& points, list<Element>::iterator it)
+void Data::addPolybezier(const vector<double>& points, unsigned int position)
 {
-    // Extend the list
-	Element dummy;
-	setPolybezier(points, dataElements.insert(it, dummy));
+	insertElement(position);
+	setPolybezier(points, position);
 }
-void Data::setPolybezier(const vector<double>& points, list<Element>::iterator it)
+void Data::setPolybezier(const vector<double>& points, unsigned int position)
 {
-	// New element
-	Element tempElement;
-	tempElement.identifier = 3;
+	setElement(3, points.empty() ? 0 : &points[0], points.size(), position);
+}
 
-	// Save parameters
-	tempElement.parameters = points;
+// Current pen condition
+Style Data::pen() const
+{
+	Style style;
+	style.width = penWidth;
+	style.foreground = penForeground;
+	style.background = penBackground;
+	return style;
+}
 
-	// Save the element
-	setElement(tempElement, it);
+// Extend the store with an empty element (private)
+void Data::insertElement(unsigned int position)
+{
+	dataElements.insert(position);
+	dataIndex.insert(position);
+	if (position < detailCount)
+		dropDetail();
+	dataGeneration++;
 }
 
 // Overwrite an existing element (private, applies current settings)
-void Data::setElement(Element& inputElement, list<Element>::iterator it)
+void Data::setElement(int identifier, const double* parameters, unsigned int count, unsigned int position)
 {
-	// Save pen condition
-	inputElement.width = penWidth;
-	inputElement.foreground = penForeground;
-	inputElement.background = penBackground;
+	// New coordinates are not subject to the pending transformation
+	flatten();
 
-	// Save the element
-	*it = inputElement;
+	// Elements reaching the edge of the image might have been holding up its bounds
+	const Bounds& previous = dataElements.bounds(position);
+	if (previous.valid() && previous.touches(cacheBounds))
+		cacheBoundsDirty = true;
 
-	// Invalidate caches
-	cacheBoundsDirty = true;
+	// Save the element
+	dataElements.set(position, identifier, parameters, count, pen());
+	if (penWidth > dataWidest)
+		dataWidest = penWidth;
+
+	// Update the caches
+	if (!cacheBoundsDirty)
+		cacheBounds.merge(dataElements.bounds(position));
+	dataIndex.update(dataElements, position);
+	if (position < detailCount)
+		dropDetail();
+	dataGeneration++;
 }
 
 
@@ -163,56 +364,13 @@ void Data::setElement(Element& inputElement, list<Element>::iterator it)
 //
 
 // Rotate the image
-inline void help_rotate(double& x, double& y, double angle_rad)
-{
-	double xc = x;
-	x = x * cos(angle_rad) - y * sin(angle_rad);
-	y = xc * sin(angle_rad) + y* cos(angle_rad);
-}
 void Data::rotate(double angle)
 {
-	// Convert the given angle
-	double angle_rad = angle / 180 * M_PI;
-
 	// Move the image to it's center
 	translate(-(imgSizeX/2), -(imgSizeY/2));
 
-    // Process all items in a parallelised manner
-    PARALLEL
-    {
-       // Create a thread
-       Thread<list<Element> > tempThread(dataElements);
-
-        // Process the range
-        for (list<Element>::iterator it = tempThread.begin; it != tempThread.end; ++it)
-        {
-            switch (it->identifier)
-            {
-                // Point
-                case 1:
-                    help_rotate(it->parameters[0], it->parameters[1], angle_rad);
-                    break;
-
-                // Polyline
-                case 2:
-                    for (unsigned int i = 0; i < it->parameters.size(); i+=2)
-                        help_rotate(it->parameters[i], it->parameters[i+1], angle_rad);
-                    break;
-
-                // Polybezier
-                case 3:
-                    for (unsigned int i = 0; i < it->parameters.size(); i+=2)
-                        help_rotate(it->parameters[i], it->parameters[i+1], angle_rad);
-                    break;
-
-                default:
-                    throw Exception("data", "rotate", "unsupported element with ID " + stringify(it->identifier));
-            }
-        }
-    }
-
-	// Invalidate caches
-	cacheBoundsDirty = true;
+	// Rotate all coordinates
+	transform(Affine::rotation(angle));
 
 	// Move the image back to it's original location
 	autocrop();
@@ -221,49 +379,20 @@ void Data::rotate(double angle)
 // Relocate the canvas
 void Data::translate(int dx, int dy)
 {
-    // Process all items in a parallelised manner
-    PARALLEL
-    {
-       // Create a thread
-       Thread<list<Element> > tempThread(dataElements);
-
-        // Process the range
-        for (list<Element>::iterator it = tempThread.begin; it != tempThread.end; ++it)
-        {
-            switch (it->identifier)
-            {
-                    // Point
-                case 1:
-                    it->parameters[0] += dx;
-                    it->parameters[1] += dy;
-                    break;
-
-                    // Polyline
-                case 2:
-                    for (unsigned int i = 0; i < it->parameters.size(); i+=2)
-                    {
-                        it->parameters[i] += dx;
-                        it->parameters[i+1] += dy;
-                    }
-                    break;
-
-                    // Polybezier
-                case 3:
-                    for (unsigned int i = 0; i < it->parameters.size(); i+=2)
-                    {
-                        it->parameters[i] += dx;
-                        it->parameters[i+1] += dy;
-                    }
-                    break;
-
-                default:
-                    throw Exception("data", "translate", "unsupported element with ID " + stringify(it->identifier));
-            }
-        }
-    }
+	transform(Affine::translation(dx, dy));
+}
 
-	// Invalidate caches
-	cacheBoundsDirty = true;
+// Scale the image
+void Data::scale(double factor)
+{
+	if (factor <= 0)
+		throw Exception("data", "scale", "invalid scale factor " + stringify(factor));
+
+	transform(Affine(factor, 0, 0, factor, 0, 0));
+
+	// Change the image's size
+	imgSizeX = (int)(imgSizeX * factor);
+	imgSizeY = (int)(imgSizeY * factor);
 }
 
 // Crop the image automatically
@@ -279,9 +408,57 @@ void Data::autocrop()
 	// Change the image's size
 	imgSizeX = x1 - x0;
 	imgSizeY = y1 - y0;
+}
 
-	// Invalidate caches
-	cacheBoundsDirty = true;
+// Apply an arbitrary affine transformation (lazily)
+void Data::transform(const Affine& matrix)
+{
+	// Compose it with the pending transformation
+	dataTransform = matrix * dataTransform;
+	dropDetail();
+	dataGeneration++;
+
+	// The bounds of the coordinates remain valid, the ones under a non-rectilinear transformation get mapped along
+	if (!cacheTransformedDirty && matrix.rectilinear())
+		cacheTransformed = cacheTransformed.transform(matrix);
+	else
+		cacheTransformedDirty = true;
+}
+
+// Apply the pending transformation to all coordinates
+void Data::flatten() const
+{
+	if (dataTransform.identity())
+		return;
+
+	// Process all coordinates in a parallelised manner (all element types consist of x/y pairs)
+	double* coordinates = dataElements.coordinates();
+	Affine matrix = dataTransform;
+	PARTITION_COORDINATES.run(0, dataElements.coordinates_size(), [=](unsigned int begin, unsigned int end)
+	{
+		transform_points(coordinates + begin, end - begin, matrix);
+	});
+
+	// Update the element boxes (rectilinear transformations map them exactly)
+	PARTITION_ELEMENTS.run(0, dataElements.size(), [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int it = begin; it < end; it++)
+		{
+			if (!matrix.rectilinear())
+				dataElements.refresh(it);
+			else if (dataElements.bounds(it).valid())
+				dataElements.bounds(it, dataElements.bounds(it).transform(matrix));
+		}
+	});
+
+	// Update the caches (again, only rectilinear transformations map the bounds exactly)
+	if (!cacheBoundsDirty && matrix.rectilinear())
+		cacheBounds = cacheBounds.transform(matrix);
+	else
+		cacheBoundsDirty = true;
+	cacheTransformedDirty = true;
+	dataIndex.transform(matrix);
+	dataTransform = Affine();
 }
 
 
@@ -290,345 +467,447 @@ void Data::autocrop()
 //
 
 // Look for exact polylines
-// Parallelisation does have a negative impact in here: per x threads more than 1,
-//   theoretically x polylines could be split
+// Every element gets extended with all following elements starting at its end point,
+//   see stitch.h for the exact rules
 void Data::search_polyline()
 {
-    // Process all items in a parallelised manner
-    PARALLEL
-    {
-        // Create a thread (barried because the list gets altered)
-        Thread<list<Element> > tempThread(dataElements);
-        #pragma omp barrier
-
-        // Process the range
-        list<Element>::iterator it = tempThread.begin;
-        while (it != tempThread.end)
-        {
-            // Initialize a polyline vector
-            vector<double> polyline;
-
-            // Add start point(s)
-            switch (it->identifier)
-            {
-                    // Point
-                case 1:
-                    polyline.reserve(2);
-                    polyline.push_back(it->parameters[0]);
-                    polyline.push_back(it->parameters[1]);
-                    break;
-
-                    // Polyline
-                case 2:
-                    polyline = it->parameters;
-                    break;
-
-                    // Not supported form
-                default:
-                    continue;
-            }
-
-            // Save the end points
-            unsigned int oldsize = polyline.size();
-            double x = polyline[oldsize - 2];
-            double y = polyline[oldsize - 1];
-
-            // Scan other elements to look for a match with those end points
-            bool found = false;
-            list<Element>::iterator it2 = it;
-            ++it2;
-            while (it2 != tempThread.end)
-            {
-                // Compare ending point
-                switch (it2->identifier)
-                {
-                    // Point
-                    case 1:
-                        if (x == it2->parameters[0] && y == it2->parameters[1])
-                            found = true;
-                        break;
-
-                    // Polyline
-                    case 2:
-                        if (x == it2->parameters[0] && y == it2->parameters[1])
-                        {
-                            int size = it2->parameters.size();
-                            for (unsigned int i = 2; i < size; i++)
-                                polyline.push_back(it2->parameters[i]);
-                            found = true;
-                        }
-                        break;
-
-                    // Not supported form
-                    default:
-                        break;
-                }
-
-                // If the line matched, remove it and push it up the temporary polyline
-                if (found)
-                {
-                    // Delete the old element
-                    it2 = dataElements.erase(it2);
-
-                    // Alter the new comparison points
-                    int newsize = polyline.size();
-                    x = polyline[newsize - 2];
-                    y = polyline[newsize - 1];
-                    found = false;
-                }
-                else
-                {
-                    ++it2;
-                }
-            }
-
-            // If the size differs, we have removed some lines, so save the resulting polyline
-            if (oldsize != polyline.size())
-            {
-                //it = dataElements.erase(it);
-                setPolyline(polyline, it);
-            }
-            else
-            {
-                ++it;
-            }
-        }
-    }
+	flatten();
+
+	// Chain all elements
+	Stitch stitch(dataElements);
+	stitch.search();
+
+	// Calculate the size of every concatenated chain
+	unsigned int count = dataElements.size();
+	vector<unsigned int> chainLength(count, 0);
+	unsigned int total = dataElements.coordinates_size();
+	for (unsigned int it = 0; it < count; it++)
+	{
+		// Only process chain heads
+		if (stitch.merged(it) || stitch.next(it) < 0)
+			continue;
+
+		// Count the start point(s), and all chained polylines but their start point
+		unsigned int size = dataElements.length(it);
+		for (int it2 = stitch.next(it); it2 >= 0; it2 = stitch.next(it2))
+			if (dataElements.identifier(it2) == 2)
+				size += dataElements.length(it2) - 2;
+
+		// If the size differs, we have merged some lines
+		if (size != dataElements.length(it))
+		{
+			chainLength[it] = size;
+			total += size;
+		}
+	}
+	dataElements.reserve(count, total);
+
+	// Replace all heads with (uninitialised) polylines, remembering where their points are
+	vector<unsigned int> sourceOffset(count, 0);
+	vector<unsigned int> sourceLength(count, 0);
+	Style style = pen();
+	for (unsigned int it = 0; it < count; it++)
+	{
+		if (chainLength[it] == 0)
+			continue;
+		sourceOffset[it] = dataElements.parameters(it) - dataElements.coordinates();
+		sourceLength[it] = dataElements.length(it);
+		dataElements.allocate(it, 2, chainLength[it], style);
+	}
+
+	// Concatenate the chains in a parallelised manner (merged elements stay in place until compaction)
+	const double* coordinates = dataElements.coordinates();
+	PARTITION_ELEMENTS.run(0, count, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int it = begin; it < end; it++)
+		{
+			if (chainLength[it] == 0)
+				continue;
+			double* result = dataElements.parameters(it);
+
+			// Start point(s)
+			result = std::copy(coordinates + sourceOffset[it], coordinates + sourceOffset[it] + sourceLength[it], result);
+
+			// All chained polylines
+			for (int it2 = stitch.next(it); it2 >= 0; it2 = stitch.next(it2))
+			{
+				if (dataElements.identifier(it2) != 2)
+					continue;
+				const double* parameters2 = dataElements.parameters(it2);
+				result = std::copy(parameters2 + 2, parameters2 + dataElements.length(it2), result);
+			}
+			dataElements.refresh(it);
+		}
+	});
+
+	// Remove all merged elements (this keeps the image bounds, as all points remain)
+	dataElements.erase(stitch.merged());
+	dataElements.compact();
+
+	// Invalidate caches
+	dataIndex.invalidate();
+	dropDetail();
+	dataGeneration++;
 }
 
 // Simplify polylines
 // See also: http://www.kevlindev.com/tutorials/geometry/simplify_polyline/index.htm
-void Data::simplify_polyline(double radius)
-{
-    // Process all items in a parallelised manner
-    PARALLEL
-    {
-        // Create a thread
-        Thread<list<Element> > tempThread(dataElements);
-
-        // Process the range
-        for (list<Element>::iterator it = tempThread.begin; it != tempThread.end; ++it)
-        {
-            switch (it->identifier)
-            {
-                case 2:
-                {
-                    vector<double> result;
-
-                    // Define last point
-                    double lastX = it->parameters[0];
-                    double lastY = it->parameters[1];
-                    double lastI = 0;
-
-                    // Starting point should always go on the result
-                    result.push_back(lastX);
-                    result.push_back(lastY);
-
-                    // Loop other points
-                    for (unsigned int i = 4; i < it->parameters.size(); i+=2)
-                    {
-                        // Define current point
-                        double curX = it->parameters[i];
-                        double curY = it->parameters[i+1];
-
-                        // Calculate primary vector coefficients
-                        double lineX = curX - lastX;
-                        double lineY = curY - lastY;
-
-                        // Loop all points in between
-                        bool falls_in_between = true;
-                        for (unsigned int j = lastI+2; j < i-2 && falls_in_between; j+=2)
-                        {
-                            // Calculate distance from point to line through secondary vector coefficients (dot product)
-                            double pointX = it->parameters[j] - lastX;
-                            double pointY = it->parameters[j+1] - lastY;
-                            double dist = abs(pointX * lineY - lineX * pointY) / sqrt(lineX * lineX + lineY * lineY);
-
-                            // Check distance
-                            if (dist > radius)
-                                falls_in_between = false;
-                        }
-
-                        if (!falls_in_between)
-                        {
-                            result.push_back(curX);
-                            result.push_back(curY);
-
-                            lastX = curX;
-                            lastY = curY;
-                            lastI = i;
-                        }
-                    }
-
-                    // And add the final point
-                    result.push_back(it->parameters[ it->parameters.size()-2 ]);
-                    result.push_back(it->parameters[ it->parameters.size()-1 ]);
-
-                    it->parameters = result;
-                    break;
-                }
-
-                default:
-                    break;
-            }
-        }
-    }
+void Data::simplify_polyline(double radius, Simplification method)
+{
+	flatten();
+
+	// Process all items in a parallelised manner
+	PARTITION_ELEMENTS.run(0, dataElements.size(), [&](unsigned int begin, unsigned int end)
+	{
+		vector<double> result;
+		vector<unsigned int> stack;
+		for (unsigned int it = begin; it < end; it++)
+		{
+			// Only process polylines
+			if (dataElements.identifier(it) != 2 || dataElements.length(it) < 2)
+				continue;
+			double* parameters = dataElements.parameters(it);
+			unsigned int size = dataElements.length(it);
+
+			// Simplify in place (the result never outgrows the original)
+			if (method == SIMPLIFY_SEQUENTIAL)
+				size = help_simplify_sequential(parameters, size, radius, result);
+			else
+				size = help_simplify_douglas_peucker(parameters, size, radius, stack);
+			dataElements.shrink(it, size);
+		}
+	});
+
+	// Reclaim the freed space
+	dataElements.compact();
 
 	// Invalidate caches
 	cacheBoundsDirty = true;
+	dataIndex.invalidate();
+	dropDetail();
+	dataGeneration++;
 }
 
 // Smoothn polylines
 // See also: http://www.sitepen.com/blog/2007/07/16/softening-polylines-with-dojox-graphics/
 void Data::smoothn_polyline(double tension)
 {
-    // Process all items in a parallelised manner
-    PARALLEL
-    {
-        // Create a thread (barried because the list gets altered)
-        Thread<list<Element> > tempThread(dataElements);
-        #pragma omp barrier
-
-        // Process the range
-        for (list<Element>::iterator it = tempThread.begin; it != tempThread.end; ++it)
-        {
-            switch (it->identifier)
-            {
-                case 2:
-                {
-                    // Resulting vector
-                    vector<double> result;
-                    result.push_back(it->parameters[0]);
-                    result.push_back(it->parameters[1]);
-
-                    // Loop polyline
-                    for (unsigned int i = 2; i < it->parameters.size(); i+=2)
-                    {
-                        result.reserve(result.size() + 6);
-
-                        // Calculate data
-                        double dx = it->parameters[i] - it->parameters[i-2];
-                        double add = dx / tension;
-
-                        // First control point
-                        result.push_back(it->parameters[i-2] + add);
-                        result.push_back(it->parameters[i-1]);
-
-                        // Second control point
-                        result.push_back(it->parameters[i] - add);
-                        result.push_back(it->parameters[i+1]);
-
-                        // End point
-                        result.push_back(it->parameters[i]);
-                        result.push_back(it->parameters[i+1]);
-                    }
-
-                    // Replace polyline with polybezier
-                    setPolybezier(result, it);
-                    break;
-                }
-
-                default:
-                    break;
-            }
-        }
-    }
+	flatten();
+
+	// Allocate room for all polybeziers at once
+	unsigned int count = dataElements.size();
+	unsigned int total = dataElements.coordinates_size();
+	for (unsigned int it = 0; it < count; it++)
+		if (dataElements.identifier(it) == 2 && dataElements.length(it) >= 2)
+			total += 2 + 3*(dataElements.length(it)-2);
+	dataElements.reserve(count, total);
+
+	// Replace all polylines with (uninitialised) polybeziers, remembering where their points are
+	vector<unsigned int> sourceOffset(count, 0);
+	vector<unsigned int> sourceLength(count, 0);
+	Style style = pen();
+	for (unsigned int it = 0; it < count; it++)
+	{
+		// Only process polylines
+		if (dataElements.identifier(it) != 2 || dataElements.length(it) < 2)
+			continue;
+		sourceOffset[it] = dataElements.parameters(it) - dataElements.coordinates();
+		sourceLength[it] = dataElements.length(it);
+		dataElements.allocate(it, 3, 2 + 3*(sourceLength[it]-2), style);
+	}
+
+	// Calculate the polybeziers in a parallelised manner
+	const double* coordinates = dataElements.coordinates();
+	PARTITION_ELEMENTS.run(0, count, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int it = begin; it < end; it++)
+		{
+			if (sourceLength[it] == 0)
+				continue;
+			const double* parameters = coordinates + sourceOffset[it];
+			unsigned int size = sourceLength[it];
+			double* result = dataElements.parameters(it);
+
+			// Start point
+			*result++ = parameters[0];
+			*result++ = parameters[1];
+
+			// Loop polyline
+			for (unsigned int i = 2; i < size; i+=2)
+			{
+				// Calculate data
+				double dx = parameters[i] - parameters[i-2];
+				double add = dx / tension;
+
+				// First control point
+				*result++ = parameters[i-2] + add;
+				*result++ = parameters[i-1];
+
+				// Second control point
+				*result++ = parameters[i] - add;
+				*result++ = parameters[i+1];
+
+				// End point
+				*result++ = parameters[i];
+				*result++ = parameters[i+1];
+			}
+			dataElements.refresh(it);
+		}
+	});
+
+	// Reclaim the space of the replaced polylines
+	dataElements.compact();
 
 	// Invalidate caches
 	cacheBoundsDirty = true;
+	dataIndex.invalidate();
+	dropDetail();
+	dataGeneration++;
+}
+
+// Fit Beziers to all polylines, within a given error
+void Data::fit_polyline(double error)
+{
+	if (error < 0)
+		throw Exception("data", "fit_polyline", "error bound cannot be negative");
+	flatten();
+
+	// Fit all curves in a parallelised manner
+	unsigned int count = dataElements.size();
+	vector<vector<double> > curves(count);
+	PARTITION_ELEMENTS.run(0, count, [&](unsigned int begin, unsigned int end)
+	{
+		Fit fit;
+		for (unsigned int it = begin; it < end; it++)
+		{
+			// Only process polylines
+			if (dataElements.identifier(it) != 2 || dataElements.length(it) < 2)
+				continue;
+			fit.bezier(dataElements.parameters(it), dataElements.length(it), error, curves[it]);
+		}
+	});
+
+	// Replace the polylines
+	for (unsigned int it = 0; it < count; it++)
+		if (!curves[it].empty())
+			setPolybezier(curves[it], it);
+
+	// Reclaim the space of the replaced polylines
+	dataElements.compact();
 }
 
 
 //
-// Information
+// Levels of detail
 //
 
-inline void help_range(int& low, int& high, const int& value)
+// The coarsest level whose error stays within a given one (building the levels if needed)
+unsigned int Data::detail(double error) const
+{
+	unsigned int level = 0;
+	while (level < DATA_DETAIL_LEVELS && detail_error(level+1) <= error)
+		level++;
+	if (level > 0)
+		buildDetail();
+	return level;
+}
+
+// The maximal error of a level (bounded by the sum of all tolerances up to it)
+double Data::detail_error(unsigned int level) const
 {
-	if (value < low || low == -1)
+	double error = 0, tolerance = DATA_DETAIL_TOLERANCE;
+	for (unsigned int it = 0; it < level; it++)
 	{
-		low = value;
+		error += tolerance;
+		tolerance *= DATA_DETAIL_FACTOR;
 	}
-	else if (value > high)	// WARNING: this could trigger a corned case where values only go down
+	return error;
+}
+
+// Get a single element at a given level of detail (elements the levels don't cover yet come as they are)
+Element Data::element(unsigned int position, unsigned int level) const
+{
+	flatten();
+	if (position < detailCount)
 	{
-		high = value;
+		for (unsigned int it = std::min(level, DATA_DETAIL_LEVELS); it > 0; it--)
+		{
+			unsigned int slot = detailSlot[it-1][position];
+			if (slot != DETAIL_NONE)
+				return detailLevels[it-1].element(slot);
+		}
 	}
+	return dataElements.element(position);
 }
 
-// Get the maximum size
+// Extend the levels of detail over all elements (private)
+void Data::buildDetail() const
+{
+	flatten();
+	unsigned int first = detailCount, count = dataElements.size();
+	if (first == count)
+		return;
+	detailLevels.resize(DATA_DETAIL_LEVELS);
+	detailSlot.resize(DATA_DETAIL_LEVELS);
+
+	// Simplify every level from the previous one
+	vector<vector<double> > simplified(count - first);
+	double tolerance = DATA_DETAIL_TOLERANCE;
+	for (unsigned int level = 0; level < DATA_DETAIL_LEVELS; level++)
+	{
+		// Process all polylines in a parallelised manner
+		PARTITION_ELEMENTS.run(first, count, [&](unsigned int begin, unsigned int end)
+		{
+			vector<unsigned int> stack;
+			for (unsigned int it = begin; it < end; it++)
+			{
+				vector<double>& result = simplified[it - first];
+				result.clear();
+
+				// Look up the previous level
+				const Store* source = &dataElements;
+				unsigned int position = it;
+				for (unsigned int previous = level; previous > 0; previous--)
+				{
+					if (detailSlot[previous-1][it] != DETAIL_NONE)
+					{
+						source = &detailLevels[previous-1];
+						position = detailSlot[previous-1][it];
+						break;
+					}
+				}
+
+				// Only keep polylines which lose points
+				if (source->identifier(position) != 2 || source->length(position) < 6)
+					continue;
+				const double* parameters = source->parameters(position);
+				result.assign(parameters, parameters + source->length(position));
+				unsigned int size = help_simplify_douglas_peucker(&result[0], result.size(), tolerance, stack, true);
+				if (size < result.size())
+					result.resize(size);
+				else
+					result.clear();
+			}
+		});
+
+		// Save them
+		detailSlot[level].resize(count, DETAIL_NONE);
+		for (unsigned int it = first; it < count; it++)
+		{
+			if (simplified[it - first].empty())
+				continue;
+			detailSlot[level][it] = detailLevels[level].size();
+			detailLevels[level].push_back(2, &simplified[it - first][0], simplified[it - first].size(), dataElements.style(it));
+		}
+		tolerance *= DATA_DETAIL_FACTOR;
+	}
+	detailCount = count;
+}
+
+// Drop all levels of detail (private)
+void Data::dropDetail()
+{
+	detailCount = 0;
+	detailLevels.clear();
+	detailSlot.clear();
+}
+
+
+//
+// Information
+//
+
+// Get the maximum size (truncated to whole pixels)
 void Data::size(int& x0, int& y0, int &x1, int& y1)
 {
-    // Have we got data?
-    if (dataElements.empty())
-    {
-        x0 = 0;
-        y0 = 0;
-        x1 = 0;
-        y1 = 0;
-    }
-
-    // Do we really need a refresh?
-    else if (!cacheBoundsDirty)
-    {
-        x0 = cacheBoundsLowerX;
-        y0 = cacheBoundsLowerY;
-        x1 = cacheBoundsUpperX;
-        y1 = cacheBoundsUpperY;
-    }
-
-    // Sadly, we do really need to calculate the size
-    else
-    {
-        // Starting value
-        x0 = -1;
-        y0 = -1;
-        x1 = 0;
-        y1 = 0;
-
-        // Process the range
-        for (list<Element>::iterator it = dataElements.begin(); it != dataElements.end(); ++it)
-        {
-            switch (it->identifier)
-            {
-                // Point
-                case 1:
-                    help_range(x0, x1, it->parameters[0]);
-                    help_range(y0, y1, it->parameters[1]);
-                    break;
-
-                // Polyline
-                case 2:
-                    for (unsigned int i = 0; i < it->parameters.size(); i+=2)
-                    {
-                        help_range(x0, x1, it->parameters[i]);
-                        help_range(y0, y1, it->parameters[i+1]);
-                    }
-                    break;
-
-                // Polybezier
-                case 3:
-                    for (unsigned int i = 0; i < it->parameters.size(); i+=2)
-                    {
-                        help_range(x0, x1, it->parameters[i]);
-                        help_range(y0, y1, it->parameters[i+1]);
-                    }
-                    break;
-
-                default:
-                    throw Exception("data", "size", "unsupported element with ID " + stringify(it->identifier));
-            }
-        }
-    }
-
-    // Save state to cache
-    if (cacheBoundsDirty)
-    {
-        cacheBoundsDirty = false;
-        cacheBoundsLowerX = x0;
-        cacheBoundsLowerY = y0;
-        cacheBoundsUpperX = x1;
-        cacheBoundsUpperY = y1;
-    }
+	// Rectilinear transformations map the bounds of the coordinates exactly
+	Bounds image;
+	if (dataTransform.rectilinear())
+	{
+		if (cacheBoundsDirty)
+		{
+			cacheBounds = Bounds();
+			for (unsigned int it = 0; it < dataElements.size(); it++)
+				cacheBounds.merge(dataElements.bounds(it));
+			cacheBoundsDirty = false;
+		}
+		image = cacheBounds;
+		if (!dataTransform.identity())
+			image = image.transform(dataTransform);
+	}
+
+	// Other ones need a look at all coordinates (this doesn't need to materialise the transformation)
+	else
+	{
+		if (cacheTransformedDirty)
+		{
+			vector<Affine> identity(1);
+			vector<Bounds> result;
+			bounds(identity, result);
+			cacheTransformed = result[0];
+			cacheTransformedDirty = false;
+		}
+		image = cacheTransformed;
+	}
+
+	// Have we got data?
+	if (!image.valid())
+	{
+		x0 = 0;
+		y0 = 0;
+		x1 = 0;
+		y1 = 0;
+	}
+	else
+	{
+		x0 = (int)image.x0;
+		y0 = (int)image.y0;
+		x1 = (int)image.x1;
+		y1 = (int)image.y1;
+	}
+}
+
+// Get the exact bounds of the coordinates, after applying each of the given transformations
+//   (all bounds get calculated in a single sweep over the coordinate buffer)
+void Data::bounds(const vector<Affine>& matrices, vector<Bounds>& result) const
+{
+	result.assign(matrices.size(), Bounds());
+	if (dataElements.coordinates_size() == 0)
+		return;
+
+	// Take the pending transformation into account
+	vector<Affine> composed(matrices.size());
+	for (unsigned int m = 0; m < matrices.size(); m++)
+		composed[m] = matrices[m] * dataTransform;
+
+	// Split contiguous runs of elements into blocks
+	vector<std::pair<unsigned int, unsigned int> > blocks;
+	const double* coordinates = dataElements.coordinates();
+	unsigned int it = 0;
+	while (it < dataElements.size())
+	{
+		const double* parameters = dataElements.parameters(it);
+		unsigned int length = dataElements.length(it);
+		for (it++; it < dataElements.size() && dataElements.parameters(it) == parameters + length; it++)
+			length += dataElements.length(it);
+
+		for (unsigned int i = 0; i < length; i+=TRANSFORM_BLOCK)
+			blocks.push_back(std::make_pair(parameters - coordinates + i, std::min(length - i, (unsigned int)TRANSFORM_BLOCK)));
+	}
+
+	// Process the blocks in a parallelised manner
+	vector<Bounds> partial(blocks.size() * composed.size());
+	PARTITION_BLOCKS.run(0, blocks.size(), [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int block = begin; block < end; block++)
+			for (unsigned int m = 0; m < composed.size(); m++)
+				transform_bounds(coordinates + blocks[block].first, blocks[block].second, composed[m], partial[block*composed.size() + m]);
+	});
+
+	// Merge the results
+	for (unsigned int block = 0; block < blocks.size(); block++)
+		for (unsigned int m = 0; m < composed.size(); m++)
+			result[m].merge(partial[block*composed.size() + m]);
 }
 
 // The amount of elements
@@ -637,28 +916,59 @@ int Data::elements() const
 	return dataElements.size();
 }
 
+// Get a single element
+Element Data::element(unsigned int position) const
+{
+	flatten();
+	return dataElements.element(position);
+}
+
+// Get all elements intersecting a region (in drawing order)
+void Data::query(const Bounds& region, vector<unsigned int>& result) const
+{
+	flatten();
+	dataIndex.query(dataElements, region, result);
+}
+
+// Get the element closest to a point, within a maximal distance (-1 if there is none)
+int Data::nearest(double x, double y, double limit) const
+{
+	flatten();
+	return dataIndex.nearest(dataElements, x, y, limit);
+}
+
+// The generation of the document (which changes with every modification)
+unsigned int Data::generation() const
+{
+	return dataGeneration;
+}
+
+// The widest pen of all elements (an upper bound, as it doesn't shrink when elements get replaced)
+int Data::widest() const
+{
+	return dataWidest;
+}
+
 // The amount of parameters
 // TODO: does parallelisation bring a speedup in small routines as this one?
 int Data::parameters() const
 {
 	// Loop elements
 	int count = 0;
-	list<Element>::const_iterator it = dataElements.begin();
-	while (it != dataElements.end())
+	for (unsigned int it = 0; it < dataElements.size(); it++)
 	{
-		switch (it->identifier)
+		switch (dataElements.identifier(it))
 		{
 			case 1:
 				count += 2;
 				break;
 			case 2:
-				count += 2*it->parameters.size();
+				count += 2*dataElements.length(it);
 			case 3:
-				count += 2*it->parameters.size();
+				count += 2*dataElements.length(it);
 			default:
 				break;
 		}
-		++it;
 	}
 	return count;
 }
@@ -20,9 +20,49 @@
  *
  */
 
-// TODO: implement "scale" functionality which alters all data points on readout
-// Needs a proper way to do. [] overloading in Element is not a proper way, as it requires do
-// de-const the data object in output.h
+/*
+ * Pending transformations
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Rotations, translations and scaling don't touch the coordinates, but get
+ * composed into a pending affine transformation. Only when the points get
+ * read (through the iterators, or by an operation working on the points
+ * themselves) the transformation gets applied, in a single pass. Rotations
+ * over a multiple of 90 degrees are exact axis swaps, and keep the cached
+ * bounds valid, so they don't even need to look at the coordinates.
+ *
+ * Document bounds
+ * ~~~~~~~~~~~~~~~
+ *
+ * The store keeps a bounding box for every element, and the bounds of all
+ * coordinates are maintained incrementally on top of those: a new or
+ * modified element simply gets merged in. Only if a modified element reached
+ * the edge of those bounds, or if an operation shrank a set of elements,
+ * they get recalculated, from the element boxes rather than from the
+ * coordinates. The image bounds follow by mapping them through the pending
+ * transformation as a whole (mapping them step by step could drift from the
+ * transformed points in the last bit). A full scan of the coordinates is
+ * only needed while a rotation over an arbitrary angle is pending.
+ *
+ * Spatial queries
+ * ~~~~~~~~~~~~~~~
+ *
+ * Region and nearest-element queries go through an R-tree over the element
+ * boxes (see index.h), which follows every modification of those boxes.
+ * Like the iterators, queries apply the pending transformation first.
+ *
+ * Levels of detail
+ * ~~~~~~~~~~~~~~~~
+ *
+ * For drawing at a small scale, simplified copies of the polylines are kept
+ * at DATA_DETAIL_LEVELS increasing tolerances. Every level gets simplified
+ * (Douglas-Peucker) from the previous one, so its error is bounded by the sum
+ * of the tolerances up to it. Only polylines which actually lose points are
+ * copied; all other elements refer to the previous level. The pyramid gets
+ * built upon request through detail(), extended with appended elements, and
+ * dropped by every other modification. Reading an element at a given level
+ * doesn't build anything, so it can happen concurrently.
+ */
 
 ///////////////////
 // CONFIGURATION //
@@ -49,78 +89,32 @@
 #include "exception.h"
 #include "generic.h"
 #include "threading.h"
+#include "store.h"
+#include "transform.h"
+#include "index.h"
 
 // Containers
 #include <vector>
-#include <list>
-#include <valarray>
 using std::vector;
-using std::list;
-using std::valarray;
+
+// Amount of simplified levels kept for polylines
+const unsigned int DATA_DETAIL_LEVELS = 4;
+
+// Simplification tolerance of the first level (every next level multiplies it by DATA_DETAIL_FACTOR)
+const double DATA_DETAIL_TOLERANCE = 1;
+const double DATA_DETAIL_FACTOR = 4;
 
 ////////////////
 // DATA TYPES //
 ////////////////
 
-// A colour
-struct Colour
-{
-	Colour()
-	{
-	}
-	Colour(int _r, int _g, int _b) : r(_r), g(_g), b(_b)
-	{
-	}
-
-	std::string rgb_hex() const
-	{
-		std::string hex = "#";
-		char buffer[3];
-		sprintf(buffer, "%.2X", r);
-		hex += buffer;
-		sprintf(buffer, "%.2X", g);
-		hex += buffer;
-		sprintf(buffer, "%.2X", b);
-		hex += buffer;
-		return hex;
-	}
-
-	wxColor rgb_wxColor() const
-	{
-		wxColor wx(r, g, b);
-		return wx;
-	}
-
-	int r;
-	int g;
-	int b;
-};
-
-// The structure
-struct Element
+// Polyline simplification algorithms (the sequential scan is quadratic in the amount of dropped points)
+enum Simplification
 {
-	// Data
-	int identifier;
-	vector<double> parameters;
-	Colour foreground;
-	Colour background;
-	int width;
+	SIMPLIFY_SEQUENTIAL,
+	SIMPLIFY_DOUGLAS_PEUCKER
 };
 
-/*
- * Possible elements
- *
- * - ID 1: a point
- *   params: x value, y value
- *
- * - ID 2: a (poly)line
- *   params: x start value, y start value, {x point value, y point value}(n times), x end value, y end value
- *
- * - ID 3: a polybezier curve
- *   params: {x start value, y start value, x control point 1, y control point 1, x control point 2, y control point 2, x end point, y end point}(n times)
- *
- */
-
 
 //////////////////////
 // CLASS DEFINITION //
@@ -145,50 +139,92 @@ class Data
 		Colour imgBackground;
 
 		// Element input
+		void reserve(unsigned int, unsigned int);
 		void addPoint(int, int);
-		void addPoint(int, int, list<Element>::iterator);
-		void setPoint(int, int, list<Element>::iterator);
+		void addPoint(int, int, unsigned int);
+		void setPoint(int, int, unsigned int);
 		void addPolyline(const vector<double>&);
-		void addPolyline(const vector<double>&, list<Element>::iterator);
-		void setPolyline(const vector<double>&, list<Element>::iterator);
+		void addPolyline(const double*, unsigned int);
+		void addPolyline(const vector<double>&, unsigned int);
+		void setPolyline(const vector<double>&, unsigned int);
 		void addPolybezier(const vector<double>&);
-		void addPolybezier(const vector<double>&, list<Element>::iterator);
-		void setPolybezier(const vector<double>&, list<Element>::iterator);
+		void addPolybezier(const vector<double>&, unsigned int);
+		void setPolybezier(const vector<double>&, unsigned int);
 
 		// Transformations
 		void rotate(double angle);
 		void translate(int dx, int dy);
+		void scale(double factor);
 		void autocrop();
+		void transform(const Affine&);
+		void flatten() const;
 
 		// Omptimalisation
 		void search_polyline();
-		void simplify_polyline(double accuracy);
+		void simplify_polyline(double accuracy, Simplification method = SIMPLIFY_DOUGLAS_PEUCKER);
 		void smoothn_polyline(double tension);
+		void fit_polyline(double error);
 
 		// Information
 		void size(int&, int&, int&, int&);
+		void bounds(const vector<Affine>&, vector<Bounds>&) const;
 		int elements() const;
 		int parameters() const;
+		int widest() const;
+		unsigned int generation() const;
+
+		// Spatial queries
+		Element element(unsigned int) const;
+		void query(const Bounds&, vector<unsigned int>&) const;
+		int nearest(double x, double y, double limit = std::numeric_limits<double>::infinity()) const;
+
+		// Levels of detail (0 being the elements themselves)
+		unsigned int detail(double error) const;
+		double detail_error(unsigned int level) const;
+		Element element(unsigned int, unsigned int level) const;
 
 		// Iterators
-		typedef list<Element>::const_iterator const_iterator;
+		typedef Store::const_iterator const_iterator;
 		const_iterator begin() const
 		{
+			flatten();
 			return dataElements.begin();
 		}
 		const_iterator end() const
 		{
+			flatten();
 			return dataElements.end();
 		}
 
 	private:
 		// Elements
-		void setElement(Element&, list<Element>::iterator);
-		list<Element> dataElements;
-
-		// Cache - image bounds
-		bool cacheBoundsDirty;
-		int cacheBoundsLowerX, cacheBoundsUpperX, cacheBoundsLowerY, cacheBoundsUpperY;
+		Style pen() const;
+		void insertElement(unsigned int);
+		void setElement(int, const double*, unsigned int, unsigned int);
+		mutable Store dataElements;
+		int dataWidest;
+		unsigned int dataGeneration;
+
+		// Spatial index over the element boxes
+		mutable Index dataIndex;
+
+		// Pending transformation
+		mutable Affine dataTransform;
+
+		// Levels of detail (the simplified polylines, and where every element can be found on every level)
+		void buildDetail() const;
+		void dropDetail();
+		mutable unsigned int detailCount;
+		mutable vector<Store> detailLevels;
+		mutable vector< vector<unsigned int> > detailSlot;
+
+		// Cache - bounds of the coordinates (without the pending transformation, recalculated from the element boxes)
+		mutable bool cacheBoundsDirty;
+		mutable Bounds cacheBounds;
+
+		// Cache - image bounds, while a non-rectilinear transformation is pending
+		mutable bool cacheTransformedDirty;
+		Bounds cacheTransformed;
 };
 
 
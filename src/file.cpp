@@ -31,6 +31,16 @@
 // Headers
 #include "file.h"
 
+// Memory mapping
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 
 //////////////
 // ROUTINES //
@@ -52,6 +62,10 @@ void file_open(std::ifstream& inputStream, const std::string& inputFile)
 	    throw Exception("file", "file_open(inputstream)", "failed to open stream");
 	}
 }
+void file_open(MappedFile& inputMapping, const std::string& inputFile)
+{
+	inputMapping.open(inputFile);
+}
 void file_open(std::ofstream& inputStream, const std::string& inputFile)
 {
 	// Open the stream
@@ -73,6 +87,10 @@ void file_close(std::ofstream& inputStream)
 {
 	inputStream.close();
 }
+void file_close(MappedFile& inputMapping)
+{
+	inputMapping.close();
+}
 
 // Identify a file
 bool file_identify(const std::string& inputFile, std::string& type)
@@ -92,3 +110,145 @@ bool file_identify(std::ifstream& inputStream, std::string& type)
 {
 	return false;
 }
+
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Mapped file
+//
+
+MappedFile::MappedFile() : mapData(0), mapSize(0), mapMapped(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// Map a file, or read it into a buffer if it cannot be mapped
+#ifndef _WIN32
+void MappedFile::open(const std::string& inputFile)
+{
+	// Release previous contents
+	close();
+
+	// Open the file
+	int descriptor = ::open(inputFile.c_str(), O_RDONLY);
+	if (descriptor == -1)
+		throw Exception("file", "file_open(mapping)", "failed to open file");
+
+	// Map regular files
+	struct stat status;
+	if (fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+	{
+		void* address = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (address != MAP_FAILED)
+		{
+			#ifdef MADV_SEQUENTIAL
+			madvise(address, status.st_size, MADV_SEQUENTIAL);
+			#endif
+			mapData = (const unsigned char*) address;
+			mapSize = status.st_size;
+			mapMapped = true;
+			::close(descriptor);
+			return;
+		}
+	}
+
+	// Fall back to buffered reading (pipes, special files, failed mappings)
+	while (true)
+	{
+		size_t offset = mapBuffer.size();
+		mapBuffer.resize(offset + FILE_CHUNK);
+		ssize_t count = ::read(descriptor, &mapBuffer[offset], FILE_CHUNK);
+		if (count < 0 && errno == EINTR)
+		{
+			mapBuffer.resize(offset);
+			continue;
+		}
+		if (count <= 0)
+		{
+			mapBuffer.resize(offset);
+			::close(descriptor);
+			if (count < 0)
+			{
+				mapBuffer.clear();
+				throw Exception("file", "file_open(mapping)", "failed to read file");
+			}
+			break;
+		}
+		mapBuffer.resize(offset + count);
+	}
+	mapData = mapBuffer.empty() ? 0 : &mapBuffer[0];
+	mapSize = mapBuffer.size();
+}
+#else
+void MappedFile::open(const std::string& inputFile)
+{
+	// Release previous contents
+	close();
+
+	// Open the file
+	std::ifstream stream(inputFile.c_str(), std::ios::in | std::ios::binary);
+	if (!stream.is_open())
+		throw Exception("file", "file_open(mapping)", "failed to open file");
+
+	// Read it into a buffer
+	while (stream)
+	{
+		size_t offset = mapBuffer.size();
+		mapBuffer.resize(offset + FILE_CHUNK);
+		stream.read((char*) &mapBuffer[offset], FILE_CHUNK);
+		mapBuffer.resize(offset + stream.gcount());
+	}
+	mapData = mapBuffer.empty() ? 0 : &mapBuffer[0];
+	mapSize = mapBuffer.size();
+}
+#endif
+
+// Release the contents
+void MappedFile::close()
+{
+	#ifndef _WIN32
+	if (mapMapped)
+		munmap((void*) mapData, mapSize);
+	#endif
+	mapBuffer.clear();
+	mapData = 0;
+	mapSize = 0;
+	mapMapped = false;
+}
+
+// Access the contents
+const unsigned char* MappedFile::data() const
+{
+	return mapData;
+}
+
+size_t MappedFile::size() const
+{
+	return mapSize;
+}
+
+bool MappedFile::mapped() const
+{
+	return mapMapped;
+}
+
+
+//
+// Cursor
+//
+
+Cursor::Cursor(const unsigned char* inputData, size_t inputSize) : cursorData(inputData), cursorSize(inputSize), cursorPosition(0)
+{
+}
+
+Cursor::Cursor(const MappedFile& inputFile) : cursorData(inputFile.data()), cursorSize(inputFile.size()), cursorPosition(0)
+{
+}
@@ -36,14 +36,114 @@
 // System headers
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <cstddef>
 
 // Application headers
 #include "exception.h"
+#include "generic.h"
+
+// Containers
+#include <vector>
+using std::vector;
 
 //
 // Constants
 //
 
+// Chunk size for buffered reads
+const size_t FILE_CHUNK = 65536;
+
+
+//////////////////////
+// CLASS DEFINITION //
+//////////////////////
+
+// The contents of a file, memory-mapped when possible (or read into a buffer
+// otherwise, e.g. for pipes)
+class MappedFile
+{
+	public:
+		// Construction and destruction
+		MappedFile();
+		~MappedFile();
+
+		// File handling
+		void open(const std::string& inputFile);
+		void close();
+
+		// Contents
+		const unsigned char* data() const;
+		size_t size() const;
+		bool mapped() const;
+
+	private:
+		// Not copyable
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		// Data
+		const unsigned char* mapData;
+		size_t mapSize;
+		bool mapMapped;
+		vector<unsigned char> mapBuffer;
+};
+
+// A bounds-checked cursor over a range of bytes
+class Cursor
+{
+	public:
+		// Construction and destruction
+		Cursor(const unsigned char* inputData, size_t inputSize);
+		Cursor(const MappedFile& inputFile);
+
+		// Position
+		size_t position() const
+		{
+			return cursorPosition;
+		}
+		size_t remaining() const
+		{
+			return cursorSize - cursorPosition;
+		}
+		bool eof() const
+		{
+			return cursorPosition == cursorSize;
+		}
+
+		// Reading (throws when reading past the end)
+		unsigned char byte()
+		{
+			check(1);
+			return cursorData[cursorPosition++];
+		}
+		const unsigned char* read(size_t count)
+		{
+			check(count);
+			const unsigned char* result = cursorData + cursorPosition;
+			cursorPosition += count;
+			return result;
+		}
+		void skip(size_t count)
+		{
+			check(count);
+			cursorPosition += count;
+		}
+
+	private:
+		// Bounds checking
+		void check(size_t count) const
+		{
+			if (count > cursorSize - cursorPosition)
+				throw Exception("file", "Cursor::read", "unexpected end of data (" + stringify(count) + " bytes requested, " + stringify(cursorSize - cursorPosition) + " left)");
+		}
+
+		// Data
+		const unsigned char* cursorData;
+		size_t cursorSize;
+		size_t cursorPosition;
+};
+
 
 /////////////////
 // DEFINITIONS //
@@ -52,10 +152,12 @@
 // Open a file
 void file_open(std::ifstream& inputStream, const std::string& inputFile);
 void file_open(std::ofstream& inputStream, const std::string& inputFile);
+void file_open(MappedFile& inputMapping, const std::string& inputFile);
 
 // Close a file
 void file_close(std::ifstream& inputStream);
 void file_close(std::ofstream& inputStream);
+void file_close(MappedFile& inputMapping);
 
 // Identify a file
 bool file_identify(const std::string& inputFile, std::string& outputType);
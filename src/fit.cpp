@@ -0,0 +1,323 @@
+/*
+ * fit.cpp
+ * Inkpad curve fitting.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Headers
+#include "fit.h"
+#include <cmath>
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+// Evaluate a cubic Bezier (given as four control points)
+inline void help_bezier(const double* curve, double u, double& x, double& y)
+{
+	double mu = 1 - u;
+	double b0 = mu*mu*mu, b1 = 3*u*mu*mu, b2 = 3*u*u*mu, b3 = u*u*u;
+	x = b0*curve[0] + b1*curve[2] + b2*curve[4] + b3*curve[6];
+	y = b0*curve[1] + b1*curve[3] + b2*curve[5] + b3*curve[7];
+}
+
+// Normalise a vector (leaving null vectors alone)
+inline void help_normalise(double& x, double& y)
+{
+	double length = sqrt(x*x + y*y);
+	if (length > 0)
+	{
+		x /= length;
+		y /= length;
+	}
+}
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Construction and destruction
+//
+
+Fit::Fit()
+{
+}
+
+
+//
+// Fitting
+//
+
+// Fit a chain of cubic Beziers to a polyline, with a given maximal distance
+void Fit::bezier(const double* points, unsigned int count, double error, vector<double>& result)
+{
+	result.clear();
+	if (count < 2)
+		return;
+
+	// Drop consecutive duplicate points
+	fitPoints.clear();
+	fitPoints.push_back(points[0]);
+	fitPoints.push_back(points[1]);
+	for (unsigned int i = 2; i+1 < count; i+=2)
+	{
+		if (points[i] == fitPoints[fitPoints.size()-2] && points[i+1] == fitPoints[fitPoints.size()-1])
+			continue;
+		fitPoints.push_back(points[i]);
+		fitPoints.push_back(points[i+1]);
+	}
+
+	// The chain starts at the first point
+	result.push_back(fitPoints[0]);
+	result.push_back(fitPoints[1]);
+	unsigned int size = fitPoints.size() / 2;
+	if (size < 2)
+		return;
+
+	// Start with the whole polyline, heading along its first and last segment
+	Range whole;
+	whole.first = 0;
+	whole.last = size - 1;
+	whole.tangent1X = fitPoints[2] - fitPoints[0];
+	whole.tangent1Y = fitPoints[3] - fitPoints[1];
+	whole.tangent2X = fitPoints[2*size-4] - fitPoints[2*size-2];
+	whole.tangent2Y = fitPoints[2*size-3] - fitPoints[2*size-1];
+	help_normalise(whole.tangent1X, whole.tangent1Y);
+	help_normalise(whole.tangent2X, whole.tangent2Y);
+	fitStack.clear();
+	fitStack.push_back(whole);
+
+	// Process all ranges, left to right
+	double limit = error * error;
+	while (!fitStack.empty())
+	{
+		Range range = fitStack.back();
+		fitStack.pop_back();
+		double curve[8];
+
+		// A single segment: place the control points at a third along the tangents
+		if (range.last - range.first == 1)
+		{
+			double x0 = fitPoints[2*range.first], y0 = fitPoints[2*range.first+1];
+			double x1 = fitPoints[2*range.last], y1 = fitPoints[2*range.last+1];
+			double distance = sqrt((x1-x0)*(x1-x0) + (y1-y0)*(y1-y0)) / 3;
+			result.push_back(x0 + range.tangent1X * distance);
+			result.push_back(y0 + range.tangent1Y * distance);
+			result.push_back(x1 + range.tangent2X * distance);
+			result.push_back(y1 + range.tangent2Y * distance);
+			result.push_back(x1);
+			result.push_back(y1);
+			continue;
+		}
+
+		// Fit a single curve
+		unsigned int split;
+		parameterise(range);
+		generate(range, curve);
+		double maximum = deviation(range, curve, split);
+
+		// Refine the parameters if it comes close
+		if (maximum > limit && maximum < FIT_REPARAMETERISE*limit)
+		{
+			for (int iteration = 0; iteration < FIT_ITERATIONS && maximum > limit; iteration++)
+			{
+				reparameterise(range, curve);
+				generate(range, curve);
+				maximum = deviation(range, curve, split);
+			}
+		}
+
+		// Keep the curve if it fits
+		if (maximum <= limit)
+		{
+			result.insert(result.end(), curve + 2, curve + 8);
+			continue;
+		}
+
+		// Split at the furthest point otherwise (pushing the right half first, so the left one comes out first)
+		double centerX, centerY;
+		tangent(split, centerX, centerY);
+		Range left = {range.first, split, range.tangent1X, range.tangent1Y, centerX, centerY};
+		Range right = {split, range.last, -centerX, -centerY, range.tangent2X, range.tangent2Y};
+		fitStack.push_back(right);
+		fitStack.push_back(left);
+	}
+}
+
+
+//
+// Fitting stages
+//
+
+// Assign parameters to all points of a range, proportional to the chord length
+void Fit::parameterise(const Range& range)
+{
+	unsigned int size = range.last - range.first + 1;
+	fitParameters.resize(size);
+	fitParameters[0] = 0;
+	for (unsigned int i = 1; i < size; i++)
+	{
+		const double* point = &fitPoints[2*(range.first+i)];
+		double dx = point[0] - point[-2];
+		double dy = point[1] - point[-1];
+		fitParameters[i] = fitParameters[i-1] + sqrt(dx*dx + dy*dy);
+	}
+	for (unsigned int i = 1; i < size; i++)
+		fitParameters[i] /= fitParameters[size-1];
+}
+
+// Least-squares fit a cubic Bezier to a range, with fixed end points and tangents
+void Fit::generate(const Range& range, double* curve) const
+{
+	double firstX = fitPoints[2*range.first], firstY = fitPoints[2*range.first+1];
+	double lastX = fitPoints[2*range.last], lastY = fitPoints[2*range.last+1];
+
+	// Accumulate the normal equations for the distances along both tangents
+	double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+	for (unsigned int i = range.first; i <= range.last; i++)
+	{
+		double u = fitParameters[i - range.first];
+		double mu = 1 - u;
+		double b0 = mu*mu*mu, b1 = 3*u*mu*mu, b2 = 3*u*u*mu, b3 = u*u*u;
+
+		double a1X = range.tangent1X * b1, a1Y = range.tangent1Y * b1;
+		double a2X = range.tangent2X * b2, a2Y = range.tangent2Y * b2;
+		c00 += a1X*a1X + a1Y*a1Y;
+		c01 += a1X*a2X + a1Y*a2Y;
+		c11 += a2X*a2X + a2Y*a2Y;
+
+		double restX = fitPoints[2*i] - (firstX*(b0+b1) + lastX*(b2+b3));
+		double restY = fitPoints[2*i+1] - (firstY*(b0+b1) + lastY*(b2+b3));
+		x0 += a1X*restX + a1Y*restY;
+		x1 += a2X*restX + a2Y*restY;
+	}
+
+	// Solve them
+	double determinant = c00*c11 - c01*c01;
+	double alpha1 = 0, alpha2 = 0;
+	if (determinant != 0)
+	{
+		alpha1 = (x0*c11 - x1*c01) / determinant;
+		alpha2 = (c00*x1 - c01*x0) / determinant;
+	}
+
+	// Fall back to a third of the chord if the solution is degenerate
+	double length = sqrt((lastX-firstX)*(lastX-firstX) + (lastY-firstY)*(lastY-firstY));
+	double epsilon = 1e-6 * length;
+	if (alpha1 < epsilon || alpha2 < epsilon)
+		alpha1 = alpha2 = length / 3;
+
+	curve[0] = firstX;
+	curve[1] = firstY;
+	curve[2] = firstX + range.tangent1X * alpha1;
+	curve[3] = firstY + range.tangent1Y * alpha1;
+	curve[4] = lastX + range.tangent2X * alpha2;
+	curve[5] = lastY + range.tangent2Y * alpha2;
+	curve[6] = lastX;
+	curve[7] = lastY;
+}
+
+// Find the largest squared distance between the points of a range and a curve, and where it occurs
+double Fit::deviation(const Range& range, const double* curve, unsigned int& split) const
+{
+	double maximum = 0;
+	split = (range.first + range.last) / 2;
+	for (unsigned int i = range.first + 1; i < range.last; i++)
+	{
+		double x, y;
+		help_bezier(curve, fitParameters[i - range.first], x, y);
+		double dx = x - fitPoints[2*i];
+		double dy = y - fitPoints[2*i+1];
+		double distance = dx*dx + dy*dy;
+		if (distance > maximum)
+		{
+			maximum = distance;
+			split = i;
+		}
+	}
+	return maximum;
+}
+
+// Move the parameters of a range towards the closest point on a curve (a Newton-Raphson step)
+void Fit::reparameterise(const Range& range, const double* curve)
+{
+	// Control points of the first and second derivative
+	double d1[6], d2[4];
+	for (int i = 0; i < 3; i++)
+	{
+		d1[2*i] = 3 * (curve[2*i+2] - curve[2*i]);
+		d1[2*i+1] = 3 * (curve[2*i+3] - curve[2*i+1]);
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		d2[2*i] = 2 * (d1[2*i+2] - d1[2*i]);
+		d2[2*i+1] = 2 * (d1[2*i+3] - d1[2*i+1]);
+	}
+
+	for (unsigned int i = range.first; i <= range.last; i++)
+	{
+		double& u = fitParameters[i - range.first];
+		double mu = 1 - u;
+
+		// Evaluate the curve and its derivatives
+		double x, y;
+		help_bezier(curve, u, x, y);
+		double x1 = mu*mu*d1[0] + 2*u*mu*d1[2] + u*u*d1[4];
+		double y1 = mu*mu*d1[1] + 2*u*mu*d1[3] + u*u*d1[5];
+		double x2 = mu*d2[0] + u*d2[2];
+		double y2 = mu*d2[1] + u*d2[3];
+
+		// Step towards the root of (Q(u) - P) . Q'(u), staying on the curve (so the deviation remains a
+		//   bound on the distance between point and curve)
+		double dx = x - fitPoints[2*i];
+		double dy = y - fitPoints[2*i+1];
+		double numerator = dx*x1 + dy*y1;
+		double denominator = x1*x1 + y1*y1 + dx*x2 + dy*y2;
+		if (denominator != 0)
+			u -= numerator / denominator;
+		if (u < 0)
+			u = 0;
+		else if (u > 1)
+			u = 1;
+	}
+}
+
+// Calculate the tangent at an inner point (pointing backwards)
+void Fit::tangent(unsigned int center, double& x, double& y) const
+{
+	x = fitPoints[2*center-2] - fitPoints[2*center+2];
+	y = fitPoints[2*center-1] - fitPoints[2*center+3];
+	if (x == 0 && y == 0)
+	{
+		x = fitPoints[2*center-2] - fitPoints[2*center];
+		y = fitPoints[2*center-1] - fitPoints[2*center+1];
+	}
+	help_normalise(x, y);
+}
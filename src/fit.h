@@ -0,0 +1,102 @@
+/*
+ * fit.h
+ * Inkpad curve fitting.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Fitting cubic Beziers
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Polylines get approximated by a chain of cubic Beziers, following the
+ * algorithm by Philip J. Schneider ("An Algorithm for Automatically Fitting
+ * Digitized Curves", Graphics Gems, 1990). Every range of points gets an
+ * initial parameterisation proportional to the chord length, after which a
+ * single Bezier is fitted with least squares, keeping the tangents at both
+ * ends fixed. If the point furthest from that curve lies within the error
+ * bound, the curve is kept. If it lies close, the parameters get refined a
+ * few times with Newton-Raphson steps first. Otherwise, the range gets split
+ * at that point, with a shared tangent so the chain stays smooth.
+ *
+ * Ranges are processed left to right with an explicit stack, so the curves
+ * come out in order. Consecutive duplicate points get dropped up front, as
+ * they would break the chord length parameterisation.
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Include guard
+#ifndef __FIT
+#define __FIT
+
+// Containers
+#include <vector>
+using std::vector;
+
+// Amount of reparameterisations before splitting a range
+const int FIT_ITERATIONS = 4;
+
+// Error bound factor (relative to the requested one) below which a range gets reparameterised
+const double FIT_REPARAMETERISE = 4;
+
+
+//////////////////////
+// CLASS DEFINITION //
+//////////////////////
+
+class Fit
+{
+	public:
+		// Construction and destruction
+		Fit();
+
+		// Fitting (the result is in polybezier format: a start point followed by control, control and end points)
+		void bezier(const double* points, unsigned int count, double error, vector<double>& result);
+
+	private:
+		// A range of points still to be fitted, with the tangents at its ends (pointing inwards)
+		struct Range
+		{
+			unsigned int first, last;
+			double tangent1X, tangent1Y;
+			double tangent2X, tangent2Y;
+		};
+
+		// Fitting stages
+		void parameterise(const Range&);
+		void generate(const Range&, double* curve) const;
+		double deviation(const Range&, const double* curve, unsigned int& split) const;
+		void reparameterise(const Range&, const double* curve);
+		void tangent(unsigned int center, double& x, double& y) const;
+
+		// Scratch buffers (reused over calls)
+		vector<double> fitPoints;
+		vector<double> fitParameters;
+		vector<Range> fitStack;
+};
+
+
+// Include guard
+#endif
@@ -0,0 +1,385 @@
+/*
+ * index.cpp
+ * Inkpad spatial index.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Headers
+#include "index.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+// Partitioners
+static const Partitioner PARTITION_SLICES(1, SCHEDULE_DYNAMIC, 4);
+static const Partitioner PARTITION_BOXES(4096, SCHEDULE_STATIC, 16384);
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+// Squared distance between a point and a box (zero inside)
+inline double help_distance_box(const Bounds& box, double x, double y)
+{
+	if (!box.valid())
+		return std::numeric_limits<double>::infinity();
+	double dx = std::max(std::max(box.x0 - x, x - box.x1), 0.0);
+	double dy = std::max(std::max(box.y0 - y, y - box.y1), 0.0);
+	return dx*dx + dy*dy;
+}
+
+// Squared distance between a point and a line segment
+inline double help_distance_segment(double x0, double y0, double x1, double y1, double x, double y)
+{
+	double dx = x1 - x0, dy = y1 - y0;
+	double length = dx*dx + dy*dy;
+	double u = 0;
+	if (length > 0)
+		u = std::min(std::max(((x - x0)*dx + (y - y0)*dy) / length, 0.0), 1.0);
+	double px = x0 + u*dx - x, py = y0 + u*dy - y;
+	return px*px + py*py;
+}
+
+// Whether an element at a given distance beats the best one so far (on equal distance, the last element
+//   wins, as it is drawn on top)
+inline bool help_closer(double distance, unsigned int position, double bestDistance, int best)
+{
+	return distance < bestDistance || (distance == bestDistance && best < (int)position
+		&& distance < std::numeric_limits<double>::infinity());
+}
+
+// A node in the best-first search (ordered on distance, closest on top)
+struct Candidate
+{
+	double distance;
+	unsigned int level, node;
+
+	bool operator<(const Candidate& other) const
+	{
+		return distance > other.distance;
+	}
+};
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Construction and destruction
+//
+
+Index::Index() : indexDirty(true), indexCount(0)
+{
+}
+
+
+//
+// Synchronisation
+//
+
+// Drop the tree (it gets rebuilt upon the next query)
+void Index::invalidate()
+{
+	indexDirty = true;
+}
+
+// An element got inserted in the store (only appending keeps the tree valid)
+void Index::insert(unsigned int position)
+{
+	if (!indexDirty && position < indexCount)
+		indexDirty = true;
+}
+
+// An element got modified in the store
+void Index::update(const Store& store, unsigned int position)
+{
+	// Unindexed elements get scanned as they are
+	if (indexDirty || position >= indexCount)
+		return;
+
+	// Replace the leaf, and grow its ancestors
+	const Bounds& box = store.bounds(position);
+	unsigned int node = indexSlot[position];
+	indexBoxes[indexLevels[0] + node] = box;
+	for (unsigned int level = 1; level+1 < indexLevels.size(); level++)
+	{
+		node /= INDEX_FANOUT;
+		indexBoxes[indexLevels[level] + node].merge(box);
+	}
+}
+
+// The coordinates of all elements got transformed
+void Index::transform(const Affine& matrix)
+{
+	if (indexDirty)
+		return;
+
+	// Rectilinear transformations map the boxes exactly, and keep the unions intact
+	if (matrix.rectilinear())
+	{
+		PARTITION_BOXES.run(0, indexBoxes.size(), [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int it = begin; it < end; it++)
+				indexBoxes[it] = indexBoxes[it].transform(matrix);
+		});
+	}
+	else
+		indexDirty = true;
+}
+
+
+//
+// Queries
+//
+
+// Elements intersecting a region (in element order)
+void Index::query(const Store& store, const Bounds& region, vector<unsigned int>& result)
+{
+	result.clear();
+	check(store);
+
+	// Descend the tree
+	if (indexCount > 0)
+	{
+		vector<Candidate> stack;
+		Candidate root = {0, (unsigned int)indexLevels.size() - 2, 0};
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			Candidate current = stack.back();
+			stack.pop_back();
+			if (!indexBoxes[indexLevels[current.level] + current.node].intersects(region))
+				continue;
+
+			if (current.level == 0)
+			{
+				result.push_back(indexEntries[current.node]);
+				continue;
+			}
+			unsigned int size = indexLevels[current.level] - indexLevels[current.level-1];
+			unsigned int end = std::min((current.node+1) * INDEX_FANOUT, size);
+			for (unsigned int child = current.node * INDEX_FANOUT; child < end; child++)
+			{
+				Candidate next = {0, current.level - 1, child};
+				stack.push_back(next);
+			}
+		}
+		std::sort(result.begin(), result.end());
+	}
+
+	// Scan the unindexed elements
+	for (unsigned int it = indexCount; it < store.size(); it++)
+	{
+		if (store.bounds(it).intersects(region))
+			result.push_back(it);
+	}
+}
+
+// Element closest to a point (within a maximal distance, -1 if there is none)
+int Index::nearest(const Store& store, double x, double y, double limit)
+{
+	check(store);
+	int best = -1;
+	double bestDistance = limit * limit;
+
+	// Scan the unindexed elements first (they come last in drawing order)
+	for (unsigned int it = store.size(); it-- > indexCount;)
+	{
+		if (help_distance_box(store.bounds(it), x, y) > bestDistance)
+			continue;
+		double current = distance(store, it, x, y);
+		if (help_closer(current, it, bestDistance, best))
+		{
+			best = it;
+			bestDistance = current;
+		}
+	}
+
+	// Search the tree, closest boxes first
+	if (indexCount > 0)
+	{
+		std::priority_queue<Candidate> queue;
+		Candidate root = {help_distance_box(indexBoxes.back(), x, y), (unsigned int)indexLevels.size() - 2, 0};
+		queue.push(root);
+		while (!queue.empty())
+		{
+			Candidate current = queue.top();
+			queue.pop();
+			if (current.distance > bestDistance)
+				break;
+
+			if (current.level == 0)
+			{
+				unsigned int position = indexEntries[current.node];
+				double exact = distance(store, position, x, y);
+				if (help_closer(exact, position, bestDistance, best))
+				{
+					best = position;
+					bestDistance = exact;
+				}
+				continue;
+			}
+			unsigned int size = indexLevels[current.level] - indexLevels[current.level-1];
+			unsigned int end = std::min((current.node+1) * INDEX_FANOUT, size);
+			for (unsigned int child = current.node * INDEX_FANOUT; child < end; child++)
+			{
+				Candidate next = {help_distance_box(indexBoxes[indexLevels[current.level-1] + child], x, y), current.level - 1, child};
+				if (next.distance <= bestDistance)
+					queue.push(next);
+			}
+		}
+	}
+
+	return best;
+}
+
+
+//
+// Construction
+//
+
+// Bulk-load the tree from the current element boxes
+void Index::build(const Store& store)
+{
+	indexCount = store.size();
+	indexDirty = false;
+	indexEntries.resize(indexCount);
+	indexSlot.resize(indexCount);
+	indexLevels.clear();
+	indexBoxes.clear();
+	if (indexCount == 0)
+		return;
+
+	// Sort key of every element (empty ones don't matter)
+	vector<double> centerX(indexCount), centerY(indexCount);
+	for (unsigned int it = 0; it < indexCount; it++)
+	{
+		const Bounds& box = store.bounds(it);
+		indexEntries[it] = it;
+		centerX[it] = box.valid() ? box.x0 + box.x1 : 0;
+		centerY[it] = box.valid() ? box.y0 + box.y1 : 0;
+	}
+
+	// Sort on x, and cut into vertical slices sorted on y
+	std::sort(indexEntries.begin(), indexEntries.end(), [&](unsigned int a, unsigned int b)
+	{
+		return centerX[a] < centerX[b];
+	});
+	unsigned int leaves = (indexCount + INDEX_FANOUT - 1) / INDEX_FANOUT;
+	unsigned int slices = (unsigned int)ceil(sqrt((double)leaves));
+	unsigned int slice = ((leaves + slices - 1) / slices) * INDEX_FANOUT;
+	PARTITION_SLICES.run(0, (indexCount + slice - 1) / slice, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int it = begin; it < end; it++)
+		{
+			std::sort(indexEntries.begin() + it*slice, indexEntries.begin() + std::min((it+1)*slice, indexCount), [&](unsigned int a, unsigned int b)
+			{
+				return centerY[a] < centerY[b];
+			});
+		}
+	});
+
+	// Fill the leaves
+	indexLevels.push_back(0);
+	indexBoxes.reserve(indexCount + indexCount / (INDEX_FANOUT-1) + 1);
+	for (unsigned int it = 0; it < indexCount; it++)
+	{
+		indexSlot[indexEntries[it]] = it;
+		indexBoxes.push_back(store.bounds(indexEntries[it]));
+	}
+	indexLevels.push_back(indexBoxes.size());
+
+	// Group every level into the next one, up to a single root
+	while (indexLevels.back() - indexLevels[indexLevels.size()-2] > 1)
+	{
+		unsigned int begin = indexLevels[indexLevels.size()-2], end = indexLevels.back();
+		for (unsigned int it = begin; it < end; it += INDEX_FANOUT)
+		{
+			Bounds box;
+			for (unsigned int child = it; child < std::min(it + INDEX_FANOUT, end); child++)
+				box.merge(indexBoxes[child]);
+			indexBoxes.push_back(box);
+		}
+		indexLevels.push_back(indexBoxes.size());
+	}
+}
+
+// Rebuild the tree if it is invalid, or if too many elements are left unindexed
+void Index::check(const Store& store)
+{
+	if (indexDirty || store.size() < indexCount
+		|| store.size() - indexCount > std::max(INDEX_OVERFLOW_MINIMUM, indexCount / INDEX_OVERFLOW))
+		build(store);
+}
+
+
+//
+// Geometry
+//
+
+// Squared distance between a point and the outline of an element
+double Index::distance(const Store& store, unsigned int position, double x, double y) const
+{
+	const double* parameters = store.parameters(position);
+	unsigned int length = store.length(position);
+	if (length < 2)
+		return std::numeric_limits<double>::infinity();
+
+	// A single point
+	double result = help_distance_segment(parameters[0], parameters[1], parameters[0], parameters[1], x, y);
+	switch (store.identifier(position))
+	{
+		// Polylines: all segments
+		case 2:
+			for (unsigned int i = 2; i+1 < length; i+=2)
+				result = std::min(result, help_distance_segment(parameters[i-2], parameters[i-1], parameters[i], parameters[i+1], x, y));
+			break;
+
+		// Polybeziers: every curve, approximated by a fixed amount of segments
+		case 3:
+			for (unsigned int i = 2; i+5 < length; i+=6)
+			{
+				const double* curve = parameters + i - 2;
+				double previousX = curve[0], previousY = curve[1];
+				for (unsigned int step = 1; step <= INDEX_BEZIER_STEPS; step++)
+				{
+					double u = (double)step / INDEX_BEZIER_STEPS, mu = 1 - u;
+					double b0 = mu*mu*mu, b1 = 3*u*mu*mu, b2 = 3*u*u*mu, b3 = u*u*u;
+					double currentX = b0*curve[0] + b1*curve[2] + b2*curve[4] + b3*curve[6];
+					double currentY = b0*curve[1] + b1*curve[3] + b2*curve[5] + b3*curve[7];
+					result = std::min(result, help_distance_segment(previousX, previousY, currentX, currentY, x, y));
+					previousX = currentX;
+					previousY = currentY;
+				}
+			}
+			break;
+	}
+	return result;
+}
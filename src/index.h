@@ -0,0 +1,130 @@
+/*
+ * index.h
+ * Inkpad spatial index.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Packed R-tree
+ * ~~~~~~~~~~~~~
+ *
+ * The bounding boxes of all elements get bulk-loaded into an R-tree with
+ * the Sort-Tile-Recursive algorithm: the elements are sorted on the x
+ * coordinate of their center, cut into vertical slices, and every slice is
+ * sorted on the y coordinate. Consecutive runs of INDEX_FANOUT boxes then
+ * form the leaves, and every level up groups the previous one likewise.
+ * All levels are stored contiguously (leaves first), so the children of a
+ * node are found by index arithmetic rather than pointers.
+ *
+ * Keeping it in sync
+ * ~~~~~~~~~~~~~~~~~~
+ *
+ * The tree doesn't get rebuilt on every modification:
+ *     - a modified element gets its leaf box replaced, and the boxes of its
+ *       ancestors grown to include it (they might become loose, but never
+ *       miss anything);
+ *     - elements appended after the tree got built are scanned linearly,
+ *       until there are enough of them to warrant a rebuild;
+ *     - rectilinear transformations get applied to all boxes in place, which
+ *       maps them exactly;
+ *     - everything else (inserting in between, removing elements, arbitrary
+ *       rotations) invalidates the tree, which gets rebuilt upon the next
+ *       query.
+ *
+ * Queries take the store as an argument, as the index doesn't own the
+ * elements it describes.
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Include guard
+#ifndef __INDEX
+#define __INDEX
+
+// Application headers
+#include "exception.h"
+#include "store.h"
+#include "transform.h"
+#include "threading.h"
+
+// Containers
+#include <vector>
+using std::vector;
+
+// Amount of children of every node
+const unsigned int INDEX_FANOUT = 16;
+
+// Share of unindexed elements (relative to the indexed ones) which triggers a rebuild
+const unsigned int INDEX_OVERFLOW = 8;
+
+// Amount of unindexed elements which never triggers a rebuild
+const unsigned int INDEX_OVERFLOW_MINIMUM = 1024;
+
+// Amount of segments to approximate a Bezier with, when measuring distances
+const unsigned int INDEX_BEZIER_STEPS = 16;
+
+
+//////////////////////
+// CLASS DEFINITION //
+//////////////////////
+
+class Index
+{
+	public:
+		// Construction and destruction
+		Index();
+
+		// Synchronisation
+		void invalidate();
+		void insert(unsigned int);
+		void update(const Store&, unsigned int);
+		void transform(const Affine&);
+
+		// Elements intersecting a region (in element order)
+		void query(const Store&, const Bounds& region, vector<unsigned int>& result);
+
+		// Element closest to a point (within a maximal distance, -1 if there is none)
+		int nearest(const Store&, double x, double y, double limit);
+
+	private:
+		// Construction
+		void build(const Store&);
+		void check(const Store&);
+
+		// Geometry
+		double distance(const Store&, unsigned int, double x, double y) const;
+
+		// Tree (the leaf level refers to elements through indexEntries)
+		bool indexDirty;
+		unsigned int indexCount;
+		vector<unsigned int> indexEntries;
+		vector<unsigned int> indexSlot;
+		vector<unsigned int> indexLevels;
+		vector<Bounds> indexBoxes;
+};
+
+
+// Include guard
+#endif
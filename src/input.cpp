@@ -39,6 +39,82 @@
 #define byte_to_value(h) (((unsigned char)h)<<0)
 
 
+////////////////
+// DATA TYPES //
+////////////////
+
+// DHW tag types
+enum
+{
+	DHW_TAG_POINT,
+	DHW_TAG_PEN,
+	DHW_TAG_TIMESTAMP,
+	DHW_TAG_LAYER,
+	DHW_TAG_UNKNOWN
+};
+
+// A DHW tag
+struct DhwTag
+{
+	unsigned char type;     // Tag type
+	unsigned char payload;  // Amount of bytes following the tag
+	bool down;              // Pen state (pen tags only)
+	const Colour* colour;   // Pen colour (pen tags only)
+};
+
+// Lookup table for all possible DHW tag bytes
+struct DhwTable
+{
+	DhwTable()
+	{
+		for (int tag = 0; tag < 256; tag++)
+		{
+			tags[tag].down = false;
+			tags[tag].colour = 0;
+
+			// Point: pattern 0XXXXXXX, 3 more coördinate bytes follow
+			if (tag < 128)
+			{
+				tags[tag].type = DHW_TAG_POINT;
+				tags[tag].payload = 3;
+			}
+
+			// Pen state: pattern 10000CCD, with colour C and pen down flag D
+			else if (tag <= 135)
+			{
+				static const Colour* colours[] = { &BLACK, &RED, &BLUE, &GREEN };
+				tags[tag].type = DHW_TAG_PEN;
+				tags[tag].payload = 0;
+				tags[tag].down = (tag % 2 == 1);
+				tags[tag].colour = colours[(tag >> 1) - 64];
+			}
+
+			// Timestamp and layer, followed by a single value byte
+			else if (tag == 0x88)
+			{
+				tags[tag].type = DHW_TAG_TIMESTAMP;
+				tags[tag].payload = 1;
+			}
+			else if (tag == 0x90)
+			{
+				tags[tag].type = DHW_TAG_LAYER;
+				tags[tag].payload = 1;
+			}
+
+			// Unknown tags get ignored
+			else
+			{
+				tags[tag].type = DHW_TAG_UNKNOWN;
+				tags[tag].payload = 0;
+			}
+		}
+	}
+
+	DhwTag tags[256];
+};
+static const DhwTable DHW_TABLE;
+
+
 ////////////////////
 // CLASS ROUTINES //
 ////////////////////
@@ -49,6 +125,8 @@
 
 Input::Input()
 {
+	// Decode whole strokes by default
+	inputStrokes = true;
 }
 
 
@@ -62,6 +140,12 @@ void Input::setData(Data* inputDataPointer)
 	data = inputDataPointer;
 }
 
+// Decode TOP files into whole strokes, or into separate line segments
+void Input::setStrokes(bool inputStrokesFlag)
+{
+	inputStrokes = inputStrokesFlag;
+}
+
 // Read from the file
 void Input::read(const std::string &inputFile)
 {
@@ -73,24 +157,30 @@ void Input::read(const std::string &inputFile)
 		return;
 	}
 
+	// Map the file, and process its contents
+	MappedFile file;
+	file_open(file, inputFile);
+	read(file.data(), file.size(), type);
+	file_close(file);
+}
+
+// Read from a memory buffer, containing data of a given type
+void Input::read(const unsigned char* inputData, size_t inputSize, const std::string &inputType)
+{
 	// Decapitalize given type
+	std::string type = inputType;
 	for (unsigned int i = 0; i < type.size(); i++)
 		type[i] = tolower(type[i]);
 
 	// Process all cases
+	Cursor cursor(inputData, inputSize);
 	if (type == "top")
 	{
-		std::ifstream stream;
-		file_open(stream, inputFile);
-		data_input_top(stream);
-		file_close(stream);
+		data_input_top(cursor);
 	}
 	else if (type == "dhw")
 	{
-		std::ifstream stream;
-		file_open(stream, inputFile);
-		data_input_dhw(stream);
-		file_close(stream);
+		data_input_dhw(cursor);
 	}
 	else
 	{
@@ -160,29 +250,22 @@ void Input::generate_static(int amount)
 // Pegasus NoteTaker file format (.pnt)
 
 // Waltop file format (.top)
-void Input::data_input_top(std::ifstream& stream)
+void Input::data_input_top(Cursor& cursor)
 {
 	// General buffer variable
-	char* buffer;
+	const unsigned char* buffer;
 
 	// Read fileheader
-	buffer = new char [6];
-	stream.read(buffer, 6);
-	if (strncmp(buffer, "WALTOP", 6) != 0)
+	if (cursor.remaining() < 6 || strncmp((const char*) cursor.read(6), "WALTOP", 6) != 0)
 	{
-		throw Exception("input", "data_input_top", "header of file seems damaged (" + stringify(buffer) + ")");
+		throw Exception("input", "data_input_top", "header of file seems damaged");
 		return;
 	}
-	delete[] buffer;
-
-	// Read first 26 bytes (unknown content)
-	buffer = new char [26];
-	stream.read(buffer, 26);
-	delete[] buffer;
 
-	// Check if file isn't empty
-	if (stream.eof())
+	// Skip 26 bytes (unknown content)
+	if (cursor.remaining() < 26)
 		return;
+	cursor.skip(26);
 
 	// Configure the pen
 	data->penWidth = 10;
@@ -194,18 +277,28 @@ void Input::data_input_top(std::ifstream& stream)
 	data->imgSizeY = 12000;
 	data->imgBackground = WHITE;
 
+	// Decode whole strokes
+	if (inputStrokes)
+	{
+		data_input_top_strokes(cursor);
+		return;
+	}
+
+	// Check if file isn't empty
+	if (cursor.remaining() < 6)
+		return;
+
 	// Initialise and read start coördinates
-	buffer = new char [6];
-	stream.read(buffer, 6);
+	buffer = cursor.read(6);
 	int x1 = dbytes_to_value(buffer[4], buffer[3]);
 	int y1 = 12000 - dbytes_to_value(buffer[2], buffer[1]);
 
-	// Read untill at end of file
+	// Read untill at end of file (ignoring a trailing partial record)
 	bool end_of_stroke = false;
-	stream.read(buffer, 6);
-	while (!stream.eof())
+	while (cursor.remaining() >= 6)
 	{
 		// Initialise and read end coördinates
+		buffer = cursor.read(6);
 		int x2 = dbytes_to_value(buffer[4], buffer[3]);
 		int y2 = 12000 - dbytes_to_value(buffer[2], buffer[1]);
 
@@ -234,58 +327,110 @@ void Input::data_input_top(std::ifstream& stream)
 		{
 			end_of_stroke = true;
 		}
-
-		// Read new bytes
-		stream.read(buffer, 6);
 	}
+}
 
-	// Clear the buffer
-	delete[] buffer;
+// Waltop file format (.top), decoded into whole strokes
+// The records following the header all are 6 bytes wide, so the body gets split into a
+//   chunk per thread, which are decoded independently. A stroke continues as long as the
+//   pen-up flag of a record isn't set (the flag of the very first record gets ignored),
+//   so strokes crossing a chunk seam are simply stitched together afterwards.
+void Input::data_input_top_strokes(Cursor& cursor)
+{
+	// Fetch all complete records
+	int records = cursor.remaining() / 6;
+	if (records < 2)
+		return;
+	const unsigned char* body = cursor.read(records * 6);
+
+	// Calculate the amount of chunks
+	int chunks = Pool::active() ? 1 : Pool::instance().size();
+	if (chunks > records / TOP_CHUNK_MINIMUM)
+		chunks = records / TOP_CHUNK_MINIMUM;
+	if (chunks < 1)
+		chunks = 1;
+
+	// Decode all chunks in a parallelised manner
+	vector<double> coordinates(2 * records);
+	vector<vector<std::pair<int, int> > > strokes(chunks);
+	Pool::instance().parallel_for(chunks, [&](unsigned int chunk_begin, unsigned int chunk_end)
+	{
+		for (unsigned int chunk = chunk_begin; chunk < chunk_end; chunk++)
+		{
+			// Calculate the range
+			int begin = (long long) records * chunk / chunks;
+			int end = (long long) records * (chunk + 1) / chunks;
+
+			// Process all records
+			int start = begin;
+			for (int i = begin; i < end; i++)
+			{
+				// Read the coördinates
+				const unsigned char* buffer = body + 6*i;
+				coordinates[2*i] = dbytes_to_value(buffer[4], buffer[3]);
+				coordinates[2*i+1] = 12000 - dbytes_to_value(buffer[2], buffer[1]);
+
+				// Close the stroke when the pen goes up, or at the end of the chunk
+				if ((i != 0 && buffer[0] == 0) || i == end - 1)
+				{
+					strokes[chunk].push_back(std::make_pair(start, i + 1));
+					start = i + 1;
+				}
+			}
+		}
+	}, false);
+
+	// Save the strokes, stitching them across chunk seams
+	data->reserve(0, 2 * records);
+	int start = 0;
+	for (int chunk = 0; chunk < chunks; chunk++)
+	{
+		for (unsigned int i = 0; i < strokes[chunk].size(); i++)
+		{
+			// A stroke at the end of a chunk continues if its last pen-up flag isn't set
+			int end = strokes[chunk][i].second;
+			if (i == strokes[chunk].size() - 1 && end < records && (end - 1 == 0 || body[6*(end-1)] != 0))
+				continue;
+
+			// Strokes need at least two points
+			if (end - start >= 2)
+				data->addPolyline(&coordinates[2*start], 2*(end - start));
+			start = end;
+		}
+	}
 }
 
 // ACECAD DigiMemo file format (.dhw)
-void Input::data_input_dhw(std::ifstream& stream)
+void Input::data_input_dhw(Cursor& cursor)
 {
-	// General buffer variable
-	char* buffer;
-
 	// Fileheader
-	buffer = new char [32];
-	stream.read(buffer, 32);
-	if (strncmp(buffer, "ACECAD_DIGIMEMO_HANDWRITING_____", 32) != 0)
+	if (cursor.remaining() < 32 || strncmp((const char*) cursor.read(32), "ACECAD_DIGIMEMO_HANDWRITING_____", 32) != 0)
 	{
-		throw Exception("input", "data_input_dhw_", "header of file seems damaged (" + stringify(buffer) + ")");
+		throw Exception("input", "data_input_dhw_", "header of file seems damaged");
 		return;
 	}
-	delete[] buffer;
 
 	// Version
-	char version = 1;
-	buffer = new char [1];
-	stream.read(buffer, 1);
-	if (strncmp(buffer, &version, 1) != 0)
+	int version = cursor.byte();
+	if (version != 1)
 	{
-	    throw Exception("input", "data_input_dhw_", "unsupported version " + stringify(buffer));
+	    throw Exception("input", "data_input_dhw_", "unsupported version " + stringify(version));
 		return;
 	}
-	delete[] buffer;
 
 	// Image size
-	buffer = new char [4];
-	stream.read(buffer, 4);
+	const unsigned char* buffer = cursor.read(4);
 	data->imgSizeX = dbytes_to_value(buffer[1], buffer[0]);
 	data->imgSizeY = dbytes_to_value(buffer[3], buffer[2]);
-	delete[] buffer;
 
 	// Background
 	data->imgBackground = WHITE;
 
 	// Page type
 	// TODO: preserve field in data structure
-	buffer = new char [1];
-	stream.read(buffer, 1);
+	int page = cursor.byte();
 	std::string type;
-	switch (byte_to_value(buffer[0]))
+	switch (page)
 	{
 		case 0:
 			type = "A5";
@@ -318,114 +463,83 @@ void Input::data_input_dhw(std::ifstream& stream)
 			type = "B4";
 			break;
 		default:
-			std::cout << "WARNING: DHW file page type is unknown (" << byte_to_value(buffer[0]) << ")" << std::endl;
+			std::cout << "WARNING: DHW file page type is unknown (" << page << ")" << std::endl;
 			type = "unknown";
 			break;
 	}
-	delete[] buffer;
 
 	// Padding bytes
-	buffer = new char[2];
-	stream.read(buffer, 2);
+	buffer = cursor.read(2);
 	if (dbytes_to_value(buffer[1], buffer[0]) != 0)
 	{
 	    throw Exception("input", "data_input_dhw_", "padding bytes invalid (" + stringify(dbytes_to_value(buffer[1], buffer[0])) + "!=0)");
 		return;
 	}
-	delete[] buffer;
+
+	// Fetch the body
+	size_t size = cursor.remaining();
+	const unsigned char* body = cursor.read(size);
+
+	// Pre-scan the body for the amount of points and strokes (a trailing partial tag is ignored)
+	unsigned int count = 0;
+	unsigned int strokes = 1;
+	size_t end = 0;
+	while (end < size)
+	{
+		const DhwTag& tag = DHW_TABLE.tags[body[end]];
+		if (end + 1 + tag.payload > size)
+			break;
+
+		if (tag.type == DHW_TAG_POINT)
+			count++;
+		else if (tag.down)
+			strokes++;
+		end += 1 + tag.payload;
+	}
+
+	// Allocate all coördinates at once
+	vector<double> points(2 * count);
+	data->reserve(strokes, 2 * count);
 
 	// Process the file
-	vector<double> points;
-	buffer = new char[1];
-	stream.read(buffer, 1);
-	while (!stream.eof())
+	unsigned int start = 0;
+	unsigned int current = 0;
+	for (size_t i = 0; i < end; i += 1 + DHW_TABLE.tags[body[i]].payload)
 	{
-	    // Process the byte
-	    int tag = byte_to_value(buffer[0]);
-
-	    // Layer
-	    if (tag == 0x90)
-	    {
-	        stream.read(buffer, 1);
-	        int data = byte_to_value(buffer[0]);
-	        //std::cout << "Layer number: " << data << std::endl;
-	    }
-
-	    // Timestamp
-	    else if (tag == 0x88)
-	    {
-	        stream.read(buffer, 1);
-	        int data = byte_to_value(buffer[0]);
-	        //std::cout << "Timestamp: " << data << std::endl;
-	    }
-
-	    // Pen state
-	    else if (tag >= 128 && tag <= 135)    // Pattern 10000XXX
-	    {
-	        // Pen up or down?
-	        if (tag%2 == 0)
-	        {
-	            // Pen up
-	            // Cannot save right now, still 1 point to follow
-	        } else {
-	            // Pen down, save previous points
-	            if (!points.empty())
-	            {
-                    data->addPolyline(points);
-                    points.clear();
-	            }
-	        }
-
-	        // Extract colour
-	        int colour = (tag >> 1)-64;
-	        switch (colour)
-	        {
-	            case 0:
-                    data->penForeground = BLACK;
-                    break;
-                case 1:
-                    data->penForeground = RED;
-                    break;
-                case 2:
-                    data->penForeground = BLUE;
-                    break;
-                case 3:
-                    data->penForeground = GREEN;
-                    break;
-                default:
-                    throw Exception("input", "data_input_dhw_", "unknown pen colour " + stringify(colour));
-                    break;
-	        }
-	    }
-
-	    // Point
-	    if (tag < 128)  // Pattern 0XXXXXXX
-	    {
-            // Read raw coördinates
-	        int x1 = byte_to_value(buffer[0]);
-	        stream.read(buffer, 1);
-	        int x2 = byte_to_value(buffer[0]);
-	        stream.read(buffer, 1);
-	        int y1 = byte_to_value(buffer[0]);
-	        stream.read(buffer, 1);
-	        int y2 = byte_to_value(buffer[0]);
-
-	        // Shift to actual coördinates
-	        double x = x1 | x2<<7;
-	        double y = data->imgSizeY - (y1 | y2<<7);
-
-	        // Push them up the temporary queue
-	        points.push_back(x);
-	        points.push_back(y);
-	    }
-
-	    // Read a new byte
-	    stream.read(buffer, 1);
+		const DhwTag& tag = DHW_TABLE.tags[body[i]];
+		switch (tag.type)
+		{
+			// Point
+			case DHW_TAG_POINT:
+			{
+				// Shift to actual coördinates
+				points[current++] = body[i] | body[i+1]<<7;
+				points[current++] = data->imgSizeY - (body[i+2] | body[i+3]<<7);
+				break;
+			}
+
+			// Pen state
+			case DHW_TAG_PEN:
+			{
+				// Pen down: save previous points
+				// (pen up cannot save right now, still 1 point to follow)
+				if (tag.down && current > start)
+				{
+					data->addPolyline(&points[start], current - start);
+					start = current;
+				}
+
+				// Extract colour
+				data->penForeground = *tag.colour;
+				break;
+			}
+
+			// Layer number, timestamp and unknown tags
+			default:
+				break;
+		}
 	}
 
 	// Push last series of points
-	data->addPolyline(points);
-
-	// Remove buffer
-	delete[] buffer;
+	data->addPolyline(points.empty() ? 0 : &points[start], current - start);
 }
@@ -43,6 +43,7 @@
 #include "generic.h"
 #include "data.h"
 #include "file.h"
+#include "threading.h"
 
 // Containers
 #include <vector>
@@ -57,6 +58,13 @@ using std::vector;
 const int GENERATE_HEIGHT = 10000;
 const int GENERATE_WIDTH = 10000;
 
+// File headers
+const int TOP_HEADER_SIZE = 32;
+const int DHW_HEADER_SIZE = 40;
+
+// Minimal amount of TOP records per decoding thread
+const int TOP_CHUNK_MINIMUM = 4096;
+
 //////////////////////
 // CLASS DEFINITION //
 //////////////////////
@@ -69,18 +77,24 @@ class Input
 
 		// Class member routines
 		void read(const std::string &inputFile);
+		void read(const unsigned char* inputData, size_t inputSize, const std::string &inputType);
 		void setData(Data*);
+		void setStrokes(bool);
 
 		// Data generation routines
 		void generate_static(int);
 
 	private:
 		// Data processing
-		void data_input_top(std::ifstream&);
-		void data_input_dhw(std::ifstream&);
+		void data_input_top(Cursor&);
+		void data_input_top_strokes(Cursor&);
+		void data_input_dhw(Cursor&);
 
 		// Data
 		Data* data;
+
+		// Configuration
+		bool inputStrokes;
 };
 
 
@@ -36,6 +36,9 @@
 #include <ctime>
 #include <wx/filename.h>
 #include <wx/cmdline.h>
+#include <wx/dir.h>
+#include <atomic>
+#include <mutex>
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
 #include <wx/wx.h>
@@ -47,6 +50,7 @@
 #include "input.h"
 #include "output.h"
 #include "data.h"
+#include "pipeline.h"
 #include "render.h"
 
 
@@ -59,13 +63,18 @@ const int BENCHMARK_DATA_OPERATION_COPY = 256;
 const int BENCHMARK_DATA_TRANSFORM_ROTATE = 128;
 const int BENCHMARK_DATA_TRANSFORM_TRANSLATE = 1024;
 const int BENCHMARK_DATA_TRANSFORM_AUTOCROP = 128;
+const int BENCHMARK_DATA_TRANSFORM_FLATTEN = 32;
+const int BENCHMARK_DATA_KERNEL = 32;
 const int BENCHMARK_DATA_OPTIMIZE_POLYSEARCH = 32;
 const int BENCHMARK_DATA_OPTIMIZE_POLYSIMP = 128;
+const int BENCHMARK_DATA_OPTIMIZE_POLYFIT = 128;
 const int BENCHMARK_DATA_OPTIMIZE_POLYSMOOTH = 128;
 const int BENCHMARK_DATA_INFORMATION_SIZE = 128;
 const int BENCHMARK_DATA_INFORMATION_ELEMENTS = 128;
 const int BENCHMARK_DATA_INFORMATION_PARAMETERS = 128;
 const int BENCHMARK_RENDER_FPS = 10;
+const int BENCHMARK_INPUT_DECODE = 8;
+const size_t BENCHMARK_INPUT_SIZE = 16*1024*1024;
 
 //////////////////////
 // CLASS DEFINITION //
@@ -94,6 +103,7 @@ enum
 
 	MENU_Settings,
 	MENU_SimplifyPolylines,
+	MENU_FitCurves,
 
 	MENU_About,
 
@@ -143,6 +153,7 @@ class Inkpad: public wxApp
 		// Initialisation
 		virtual bool OnInit();
 		bool InitBatch();
+		bool InitBatchMultiple();
 		bool InitGui();
 		bool InitBenchmark();
 
@@ -157,6 +168,18 @@ class Inkpad: public wxApp
 
 		// Application mode
 		std::string mode;
+
+		// Input configuration
+		bool segments;
+
+		// Batch conversion
+		void batch_convert(Input&, Data&, Output&, const std::string&, const std::string&);
+		void batch_expand(const wxString&, vector<wxString>&);
+		vector<wxString> batch_inputs;
+		wxString batch_directory;
+		wxString batch_format;
+		long batch_jobs;
+		Pipeline batch_pipeline;
 };
 
 // Configure the command-line parameters
@@ -169,16 +192,36 @@ static const wxCmdLineEntryDesc g_cmdLineDesc [] =
 	  wxCMD_LINE_VAL_NONE},
 	{ wxCMD_LINE_SWITCH, wxT("m"), wxT("benchmark"), wxT("benchmark the application"),
 	  wxCMD_LINE_VAL_NONE},
+	{ wxCMD_LINE_SWITCH, wxT("s"), wxT("segments"), wxT("read TOP files as separate line segments instead of strokes"),
+	  wxCMD_LINE_VAL_NONE},
+	{ wxCMD_LINE_SWITCH, wxT("ba"), wxT("batch-autocrop"), wxT("crop the image automatically"),
+	  wxCMD_LINE_VAL_NONE},
 
 	// Options
 	{ wxCMD_LINE_OPTION, wxT("bi"), wxT("batch-input"), wxT("read from specific file"),
 	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
 	{ wxCMD_LINE_OPTION, wxT("bo"), wxT("batch-output"), wxT("write to specific file"),
 	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bd"), wxT("batch-directory"), wxT("convert all given files, directories or patterns into a specific directory"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bf"), wxT("batch-format"), wxT("file type to convert to (default: svg)"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bj"), wxT("batch-jobs"), wxT("amount of files to convert concurrently"),
+	  wxCMD_LINE_VAL_NUMBER, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("br"), wxT("batch-rotate"), wxT("rotate the image over a given angle (in degrees)"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bt"), wxT("batch-translate"), wxT("relocate the image (given as DX,DY)"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bs"), wxT("batch-simplify"), wxT("simplify polylines within a given radius"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bc"), wxT("batch-curves"), wxT("fit curves to polylines within a given error"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
+	{ wxCMD_LINE_OPTION, wxT("bm"), wxT("batch-smoothn"), wxT("smoothn polylines with a given tension"),
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_NEEDS_SEPARATOR },
 
 	// Standard unnamed parameter
 	{ wxCMD_LINE_PARAM, 0, 0, wxT("FILE"),
-	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
+	  wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE },
 
 	{ wxCMD_LINE_NONE }
 };
@@ -219,6 +262,7 @@ class FrameMain: public wxFrame
 		// Tools menu
 		void OnMenuSettings(wxCommandEvent& event);
 		void OnMenuSimplifyPolylines(wxCommandEvent& event);
+		void OnMenuFitCurves(wxCommandEvent& event);
 
 		// Help menu
 		void OnMenuAbout(wxCommandEvent& event);
@@ -250,6 +294,7 @@ BEGIN_EVENT_TABLE(FrameMain, wxFrame)
 
 	EVT_MENU(MENU_Settings, FrameMain::OnMenuSettings)
 	EVT_MENU(MENU_SimplifyPolylines, FrameMain::OnMenuSimplifyPolylines)
+	EVT_MENU(MENU_FitCurves, FrameMain::OnMenuFitCurves)
 
 	EVT_MENU(MENU_About, FrameMain::OnMenuAbout)
 
@@ -277,9 +322,27 @@ class DrawPane : public wxPanel
 		void eventPaint(wxPaintEvent&);
 		void eventEraseBackground(wxEraseEvent&);
 		void eventSize(wxSizeEvent&);
+		void eventWheel(wxMouseEvent&);
+		void eventLeftDown(wxMouseEvent&);
+		void eventLeftUp(wxMouseEvent&);
+		void eventMotion(wxMouseEvent&);
+		void eventCaptureLost(wxMouseCaptureLostEvent&);
+		void eventTimer(wxTimerEvent&);
 
 		void render(wxDC& dc);
 
+	private:
+		// Checking for frames rendered in the background
+		wxTimer timer;
+
+		// Panning (the last mouse position)
+		bool dragging;
+		int dragX, dragY;
+
+		// Generation of the data described in the status bar
+		bool statusValid;
+		unsigned int statusGeneration;
+
 		DECLARE_EVENT_TABLE()
 
 };
@@ -289,6 +352,12 @@ BEGIN_EVENT_TABLE(DrawPane, wxPanel)
 	EVT_PAINT(DrawPane::eventPaint)
 	EVT_ERASE_BACKGROUND(DrawPane::eventEraseBackground)
 	EVT_SIZE(DrawPane::eventSize)
+	EVT_MOUSEWHEEL(DrawPane::eventWheel)
+	EVT_LEFT_DOWN(DrawPane::eventLeftDown)
+	EVT_LEFT_UP(DrawPane::eventLeftUp)
+	EVT_MOTION(DrawPane::eventMotion)
+	EVT_MOUSE_CAPTURE_LOST(DrawPane::eventCaptureLost)
+	EVT_TIMER(wxID_ANY, DrawPane::eventTimer)
 END_EVENT_TABLE()
 
 
@@ -324,6 +393,9 @@ bool Inkpad::OnInit()
 	engineOutput->setData(engineData);
 	engineRender->setData(engineData);
 
+	// Configure the input engine
+	engineInput->setStrokes(!segments);
+
 	// Call specific initialiser
 	if (mode == "batch")
 	{
@@ -342,18 +414,16 @@ bool Inkpad::OnInit()
 // Specific initialisation: batch mode
 bool Inkpad::InitBatch()
 {
-	try
+	// Convert multiple files
+	if (!batch_directory.IsEmpty())
 	{
-		// Read file
-		engineInput->read(std::string(getfile_load().GetFullPath().mb_str()));
-
-		// Detect polylines (lossless)
-		engineData->search_polyline();
-
-		// Do other requested transformations
+		return InitBatchMultiple();
+	}
 
-		// Write file
-		engineOutput->write(std::string(getfile_save().GetFullPath().mb_str()));
+	try
+	{
+		// Convert the file
+		batch_convert(*engineInput, *engineData, *engineOutput, std::string(getfile_load().GetFullPath().mb_str()), std::string(getfile_save().GetFullPath().mb_str()));
 	}
 	catch (Exception tempException)
 	{
@@ -363,6 +433,68 @@ bool Inkpad::InitBatch()
 	return false;
 }
 
+// Specific initialisation: batch mode, converting multiple files
+bool Inkpad::InitBatchMultiple()
+{
+	// Expand all inputs
+	vector<wxString> files;
+	for (unsigned int i = 0; i < batch_inputs.size(); i++)
+		batch_expand(batch_inputs[i], files);
+
+	// Generate the output file names
+	int count = files.size();
+	vector<std::string> inputs(count), outputs(count);
+	for (int i = 0; i < count; i++)
+	{
+		wxFileName output(batch_directory, wxFileName(files[i]).GetName(), batch_format);
+		inputs[i] = std::string(files[i].mb_str());
+		outputs[i] = std::string(output.GetFullPath().mb_str());
+	}
+
+	// Convert all files on a bounded amount of threads, one file per task
+	Pool::instance().resize(batch_jobs);
+	std::atomic<int> converted(0);
+	std::mutex report;
+	Pool::instance().parallel_for(count, [&](unsigned int begin, unsigned int end)
+	{
+		// Every task gets its own set of engines
+		Data workerData;
+		Input workerInput;
+		Output workerOutput;
+		workerInput.setData(&workerData);
+		workerInput.setStrokes(!segments);
+		workerOutput.setData(&workerData);
+
+		for (unsigned int i = begin; i < end; i++)
+		{
+			std::string status;
+			try
+			{
+				workerData.clear();
+				batch_convert(workerInput, workerData, workerOutput, inputs[i], outputs[i]);
+				status = "converted to " + outputs[i];
+				converted++;
+			}
+			catch (Exception tempException)
+			{
+				status = std::string("failed, library ") + tempException.who() + " caught an error in " + tempException.where() + ": " + tempException.what();
+			}
+			catch (std::exception& tempException)
+			{
+				status = std::string("failed: ") + tempException.what();
+			}
+
+			// Report the status
+			std::lock_guard<std::mutex> guard(report);
+			std::cout << "* " << inputs[i] << ": " << status << std::endl;
+		}
+	});
+
+	std::cout << "Converted " << converted << " out of " << count << " files" << std::endl;
+
+	return false;
+}
+
 // Specific initialisation: benchmark mode
 bool Inkpad::InitBenchmark()
 {
@@ -396,6 +528,66 @@ bool Inkpad::InitBenchmark()
 	wxMemoryDC dc;
 	dc.SelectObject(bitmap);
 
+	//
+	// Input decoding
+	//
+
+	if (getfile_load().IsOk())
+	{
+		std::cout << "* Input: decoding" << std::endl;
+
+		try
+		{
+			// Map the given file
+			std::string file = std::string(getfile_load().GetFullPath().mb_str());
+			std::string type;
+			file_identify(file, type);
+			for (unsigned int i = 0; i < type.size(); i++)
+				type[i] = tolower(type[i]);
+			MappedFile mapping;
+			file_open(mapping, file);
+
+			// Determine the header size, and the body which can be repeated
+			size_t header = 0;
+			size_t body = 0;
+			if (type == "top")
+			{
+				header = TOP_HEADER_SIZE;
+				body = (mapping.size() - header) / 6 * 6;
+			}
+			else if (type == "dhw")
+			{
+				header = DHW_HEADER_SIZE;
+				body = mapping.size() - header;
+			}
+			if (mapping.size() < header || body == 0)
+				throw Exception("main", "InitBenchmark", "cannot scale up file of type " + type);
+
+			// Scale the file up, by repeating its body
+			vector<unsigned char> scaled(mapping.data(), mapping.data() + header);
+			while (scaled.size() < BENCHMARK_INPUT_SIZE)
+				scaled.insert(scaled.end(), mapping.data() + header, mapping.data() + header + body);
+			file_close(mapping);
+
+			// Decode
+			std::cout << "\t- " << type << " (" << scaled.size() / (1024*1024) << " MB): ";
+			stopwatch.Start();
+			for (int i = 0; i < BENCHMARK_INPUT_DECODE; i++)
+			{
+				Data tempData;
+				Input tempInput;
+				tempInput.setData(&tempData);
+				tempInput.setStrokes(!segments);
+				tempInput.read(&scaled[0], scaled.size(), type);
+			}
+			std::cout << 1000.0*BENCHMARK_INPUT_DECODE*scaled.size()/(1024*1024)/stopwatch.Time() << " MB per second" << std::endl;
+		}
+		catch (Exception tempException)
+		{
+			std::cout << "Library " << tempException.who() << " caught an error in " << tempException.where() << ": " << tempException.what() << std::endl;
+		}
+	}
+
 	//
 	// Data operations
 	//
@@ -433,6 +625,16 @@ bool Inkpad::InitBenchmark()
 	}
 	std::cout << 1000*BENCHMARK_DATA_TRANSFORM_TRANSLATE/stopwatch.Time() << " per second" << std::endl;
 
+	// Materialisation (rotations and translations are deferred until the points get read)
+	std::cout << "\t- materialisations: ";
+	stopwatch.Start();
+	for (int i = 0; i < BENCHMARK_DATA_TRANSFORM_FLATTEN; i++)
+	{
+		engineData->rotate(45);
+		engineData->flatten();
+	}
+	std::cout << 1000*BENCHMARK_DATA_TRANSFORM_FLATTEN/stopwatch.Time() << " per second" << std::endl;
+
     // autocrop
     std::cout << "\t- autocrops: ";
     int dummy;
@@ -446,6 +648,36 @@ bool Inkpad::InitBenchmark()
     std::cout << 1000*BENCHMARK_DATA_TRANSFORM_AUTOCROP/stopwatch.Time() << " per second" << std::endl;
 
 
+	//
+	// Data kernels
+	//
+
+	std::cout << "* Data: kernels" << std::endl;
+
+	// Materialisations and bounds, using every supported instruction set
+	TransformIsa isaBest = transform_supported();
+	vector<Affine> identity(1);
+	vector<Bounds> bounds;
+	for (int isa = TRANSFORM_SCALAR; isa <= isaBest; isa++)
+	{
+		transform_isa((TransformIsa)isa);
+		std::cout << "\t- " << transform_name((TransformIsa)isa) << ": ";
+		stopwatch.Start();
+		for (int i = 0; i < BENCHMARK_DATA_KERNEL; i++)
+		{
+			engineData->rotate(45);
+			engineData->flatten();
+		}
+		long timeTransform = stopwatch.Time();
+		stopwatch.Start();
+		for (int i = 0; i < BENCHMARK_DATA_KERNEL; i++)
+			engineData->bounds(identity, bounds);
+		long timeBounds = stopwatch.Time();
+		std::cout << 1000.0*BENCHMARK_DATA_KERNEL/timeTransform << " transformations and " << 1000.0*BENCHMARK_DATA_KERNEL/timeBounds << " bounds per second" << std::endl;
+	}
+	transform_isa(isaBest);
+
+
 	//
 	// Data optimalisations
 	//
@@ -471,6 +703,24 @@ bool Inkpad::InitBenchmark()
         tempData.simplify_polyline(1);
     }
     std::cout << 1000*BENCHMARK_DATA_OPTIMIZE_POLYSIMP/stopwatch.Time() << " per second" << std::endl;
+    std::cout << "\t- polyline simplifications (sequential): ";
+    stopwatch.Start();
+    for (int i = 0; i < BENCHMARK_DATA_OPTIMIZE_POLYSIMP; i++)
+    {
+        Data tempData(*engineData);
+        tempData.simplify_polyline(1, SIMPLIFY_SEQUENTIAL);
+    }
+    std::cout << 1000*BENCHMARK_DATA_OPTIMIZE_POLYSIMP/stopwatch.Time() << " per second" << std::endl;
+
+    // Fit curves
+    std::cout << "\t- polyline fits: ";
+    stopwatch.Start();
+    for (int i = 0; i < BENCHMARK_DATA_OPTIMIZE_POLYFIT; i++)
+    {
+        Data tempData(*engineData);
+        tempData.fit_polyline(1);
+    }
+    std::cout << 1000*BENCHMARK_DATA_OPTIMIZE_POLYFIT/stopwatch.Time() << " per second" << std::endl;
 
     // Smooth polyline
     std::cout << "\t- polyline smoothns: ";
@@ -488,15 +738,13 @@ bool Inkpad::InitBenchmark()
     //
 
     std::cout << "* Data: information" << std::endl;
-    engineData->translate(0, 0);
 
-    // Size
+    // Size (calculating the bounds from scratch, as size() caches them)
     std::cout << "\t- size calculations: ";
     stopwatch.Start();
     for (int i = 0; i < BENCHMARK_DATA_INFORMATION_SIZE; i++)
     {
-        Data tempData(*engineData);
-        tempData.size(dummy, dummy, dummy, dummy);
+        engineData->bounds(identity, bounds);
     }
     std::cout << 1000*BENCHMARK_DATA_INFORMATION_SIZE/stopwatch.Time() << " per second" << std::endl;
 
@@ -532,21 +780,29 @@ bool Inkpad::InitBenchmark()
 	vector<std::string> engines;
 	engineRender->render_available(engines);
 
-	// Test them all
+	// Test them all (Cairo both in a single pass and tiled)
 	for (int i = 0; i < engines.size(); i++)
 	{
-
-		// Test
-		std::cout << "\t- " << engines[i] << ": ";
-		stopwatch.Start();
-		for (int j = 0; j < BENCHMARK_RENDER_FPS; j++)
+		for (int tiled = 0; tiled < 2; tiled++)
 		{
-			engineRender->write(dc, engines[i]);
-		}
+			if (tiled && engines[i] != "cairo")
+				continue;
+			engineRender->tiled = tiled;
+
+			// Test
+			std::cout << "\t- " << engines[i] << (tiled ? " (tiled)" : "") << ": ";
+			stopwatch.Start();
+			for (int j = 0; j < BENCHMARK_RENDER_FPS; j++)
+			{
+				engineRender->invalidate();
+				engineRender->write(dc, engines[i]);
+			}
 
-		// Output
-		std::cout << 1000*BENCHMARK_RENDER_FPS/stopwatch.Time() << " frames per second" << std::endl;
+			// Output
+			std::cout << 1000*BENCHMARK_RENDER_FPS/stopwatch.Time() << " frames per second" << std::endl;
+		}
 	}
+	engineRender->tiled = true;
 
 	return false;
 }
@@ -576,9 +832,10 @@ bool Inkpad::InitGui()
 		}
 	}
 
-	// Add a new drawpane
+	// Add a new drawpane (which renders in the background, to stay responsive)
 	drawPane = new DrawPane((wxFrame*) frame);
 	drawPane->parent = this;
+	engineRender->background = true;
 	wxBoxSizer* sizer = new wxBoxSizer(wxHORIZONTAL);
 	sizer->Add(drawPane, 1, wxEXPAND);
 	frame->SetSizer(sizer);
@@ -591,6 +848,64 @@ bool Inkpad::InitGui()
 	return true;
 }
 
+//
+// Batch conversion
+//
+
+// Convert a single file
+void Inkpad::batch_convert(Input& input, Data& data, Output& output, const std::string& inputFile, const std::string& outputFile)
+{
+	// Read file
+	input.read(inputFile);
+
+	// Detect polylines (lossless)
+	data.search_polyline();
+
+	// Do other requested transformations
+	batch_pipeline.run(data);
+
+	// Write file
+	output.write(outputFile);
+}
+
+// Expand a batch input (a file, a directory, or a wildcard pattern) into a set of files
+void Inkpad::batch_expand(const wxString& input, vector<wxString>& files)
+{
+	// Directory: all files of a supported type
+	if (wxDirExists(input))
+	{
+		wxArrayString entries;
+		wxDir::GetAllFiles(input, &entries, wxEmptyString, wxDIR_FILES);
+		entries.Sort();
+		for (unsigned int i = 0; i < entries.GetCount(); i++)
+		{
+			wxString extension = wxFileName(entries[i]).GetExt().Lower();
+			if (extension == wxT("top") || extension == wxT("dhw"))
+				files.push_back(entries[i]);
+		}
+	}
+
+	// Wildcard pattern: all matching files
+	else if (wxIsWild(input))
+	{
+		wxFileName pattern(input);
+		wxString directory = pattern.GetPath().IsEmpty() ? wxString(wxT(".")) : pattern.GetPath();
+		wxArrayString entries;
+		if (wxDirExists(directory))
+			wxDir::GetAllFiles(directory, &entries, pattern.GetFullName(), wxDIR_FILES);
+		entries.Sort();
+		for (unsigned int i = 0; i < entries.GetCount(); i++)
+			files.push_back(entries[i]);
+	}
+
+	// Single file
+	else
+	{
+		files.push_back(input);
+	}
+}
+
+
 //
 // File handling
 //
@@ -641,6 +956,9 @@ bool Inkpad::OnCmdLineParsed(wxCmdLineParser& parser)
 		setfile_load(wxFileName(parser.GetParam(0)));
 	}
 
+	// Input configuration
+	segments = parser.Found(wxT("s"));
+
 	// Mode: batch
 	if (parser.Found(wxT("b")))
 	{
@@ -658,8 +976,88 @@ bool Inkpad::OnCmdLineParsed(wxCmdLineParser& parser)
 			setfile_save(wxFileName(paramOutput));
 		}
 
+		// Configure the transformations (applied in a fixed order)
+		wxString paramRotate, paramTranslate, paramSimplify, paramCurves, paramSmoothn;
+		double angle, radius, error, tension;
+		long dx, dy;
+		if (parser.Found(wxT("br"), &paramRotate))
+		{
+			if (!paramRotate.ToDouble(&angle))
+			{
+				std::cout << "Invalid rotation angle" << std::endl;
+				parser.Usage();
+				return false;
+			}
+			batch_pipeline.addRotate(angle);
+		}
+		if (parser.Found(wxT("bt"), &paramTranslate))
+		{
+			if (!paramTranslate.BeforeFirst(wxT(',')).ToLong(&dx) || !paramTranslate.AfterFirst(wxT(',')).ToLong(&dy))
+			{
+				std::cout << "Invalid translation (expected DX,DY)" << std::endl;
+				parser.Usage();
+				return false;
+			}
+			batch_pipeline.addTranslate(dx, dy);
+		}
+		if (parser.Found(wxT("ba")))
+		{
+			batch_pipeline.addAutocrop();
+		}
+		if (parser.Found(wxT("bs"), &paramSimplify))
+		{
+			if (!paramSimplify.ToDouble(&radius) || radius < 0)
+			{
+				std::cout << "Invalid simplification radius" << std::endl;
+				parser.Usage();
+				return false;
+			}
+			batch_pipeline.addSimplify(radius);
+		}
+		if (parser.Found(wxT("bc"), &paramCurves))
+		{
+			if (!paramCurves.ToDouble(&error) || error < 0)
+			{
+				std::cout << "Invalid curve fitting error" << std::endl;
+				parser.Usage();
+				return false;
+			}
+			batch_pipeline.addFit(error);
+		}
+		if (parser.Found(wxT("bm"), &paramSmoothn))
+		{
+			if (!paramSmoothn.ToDouble(&tension) || tension == 0)
+			{
+				std::cout << "Invalid smoothing tension" << std::endl;
+				parser.Usage();
+				return false;
+			}
+			batch_pipeline.addSmoothn(tension);
+		}
+
+		// Configure conversion of multiple files (given as unnamed parameters)
+		if (parser.Found(wxT("bd"), &batch_directory))
+		{
+			for (unsigned int i = 0; i < parser.GetParamCount(); i++)
+				batch_inputs.push_back(parser.GetParam(i));
+			if (!paramInput.IsEmpty())
+				batch_inputs.push_back(paramInput);
+			if (!parser.Found(wxT("bf"), &batch_format))
+				batch_format = wxT("svg");
+			batch_jobs = Pool::instance().size();
+			parser.Found(wxT("bj"), &batch_jobs);
+
+			// Require input files and a valid output directory
+			if (batch_inputs.empty() || !wxDirExists(batch_directory) || batch_jobs < 1)
+			{
+				std::cout << "Batch conversion of multiple files requires input files and an existing output directory" << std::endl;
+				parser.Usage();
+				return false;
+			}
+		}
+
 		// Require input and output file
-		if (!getfile_load().IsOk() || !getfile_save().IsOk())
+		else if (!getfile_load().IsOk() || !getfile_save().IsOk())
 		{
 			std::cout << "Batch mode requires given input and output parameters" << std::endl;
 			parser.Usage();
@@ -726,6 +1124,7 @@ FrameMain::FrameMain(const wxString& title, const wxPoint& pos, const wxSize& si
 	menuTools->Append(MENU_Settings, _T("&Settings"));
 	menuTools->AppendSeparator();
 	menuTools->Append(MENU_SimplifyPolylines, _T("Simplify &polylines"));
+	menuTools->Append(MENU_FitCurves, _T("Fit &curves"));
 
 	// Help menu
 	wxMenu *menuHelp = new wxMenu;
@@ -790,6 +1189,9 @@ void FrameMain::OnMenuOpen(wxCommandEvent& WXUNUSED(event))
 			// Detect polylines (lossless)
 			parent->engineData->search_polyline();
 
+			// Fit the new page
+			parent->engineRender->reset();
+
 			// Save the loaded file
 			parent->setfile_load(OpenDialog->GetPath());
 
@@ -943,16 +1345,36 @@ void FrameMain::OnMenuAutocrop(wxCommandEvent& WXUNUSED(event))
 // Zoom in
 void FrameMain::OnMenuZoomIn(wxCommandEvent& WXUNUSED(event))
 {
+	// Zoom around the center of the view
+	int width, height;
+	parent->drawPane->GetClientSize(&width, &height);
+	parent->engineRender->zoom(RENDER_ZOOM_STEP, width, height);
+
+	// Redraw
+	parent->drawPane->Refresh();
 }
 
 // Zoom out
 void FrameMain::OnMenuZoomOut(wxCommandEvent& WXUNUSED(event))
 {
+	// Zoom around the center of the view
+	int width, height;
+	parent->drawPane->GetClientSize(&width, &height);
+	parent->engineRender->zoom(1/RENDER_ZOOM_STEP, width, height);
+
+	// Redraw
+	parent->drawPane->Refresh();
 }
 
 // View the image full-screen
 void FrameMain::OnMenuFullscreen(wxCommandEvent& WXUNUSED(event))
 {
+	// Toggle
+	ShowFullScreen(!IsFullScreen());
+
+	// Fit the page again
+	parent->engineRender->reset();
+	parent->drawPane->Refresh();
 }
 
 
@@ -983,6 +1405,24 @@ void FrameMain::OnMenuSimplifyPolylines(wxCommandEvent& WXUNUSED(event))
 	}
 }
 
+// Fit curves to polylines
+void FrameMain::OnMenuFitCurves(wxCommandEvent& WXUNUSED(event))
+{
+	// Redraw
+	try
+	{
+		parent->engineData->fit_polyline(1.5);
+		parent->drawPane->Refresh();
+	}
+    catch (Exception tempException)
+	{
+	    wxString tempLibrary = wxString(tempException.who(), wxConvUTF8);
+	    wxString tempLocation = wxString(tempException.where(), wxConvUTF8);
+	    wxString tempError = wxString(tempException.what(), wxConvUTF8);
+	    wxLogError(_T("Library ") + tempLibrary + _T(" caught an error in ") + tempLocation + _T(": ") + tempError + _T("."));
+	}
+}
+
 //
 // Help-menu
 //
@@ -1045,7 +1485,7 @@ void FrameMain::OnToolRight(wxCommandEvent& WXUNUSED(event))
 //
 
 // Constructor
-DrawPane::DrawPane(wxFrame* _parent) : wxPanel(_parent)
+DrawPane::DrawPane(wxFrame* _parent) : wxPanel(_parent), timer(this), dragging(false), dragX(0), dragY(0), statusValid(false), statusGeneration(0)
 {
 }
 
@@ -1074,6 +1514,65 @@ void DrawPane::eventSize(wxSizeEvent& event)
 	this->Refresh();
 }
 
+// Zoom around the mouse position
+void DrawPane::eventWheel(wxMouseEvent& event)
+{
+	if (event.GetWheelRotation() == 0)
+		return;
+
+	int width, height;
+	GetClientSize(&width, &height);
+	double factor = event.GetWheelRotation() > 0 ? RENDER_ZOOM_STEP : 1/RENDER_ZOOM_STEP;
+	parent->engineRender->zoom(factor, width, height, event.GetX(), event.GetY());
+	Refresh();
+}
+
+// Start dragging the page around
+void DrawPane::eventLeftDown(wxMouseEvent& event)
+{
+	dragging = true;
+	dragX = event.GetX();
+	dragY = event.GetY();
+	CaptureMouse();
+}
+
+// Stop dragging
+void DrawPane::eventLeftUp(wxMouseEvent& WXUNUSED(event))
+{
+	dragging = false;
+	if (HasCapture())
+		ReleaseMouse();
+}
+
+// Drag the page along with the mouse
+void DrawPane::eventMotion(wxMouseEvent& event)
+{
+	if (!dragging || !event.LeftIsDown())
+		return;
+
+	int width, height;
+	GetClientSize(&width, &height);
+	parent->engineRender->pan(event.GetX() - dragX, event.GetY() - dragY, width, height);
+	dragX = event.GetX();
+	dragY = event.GetY();
+	Refresh();
+}
+
+// Another window took the mouse
+void DrawPane::eventCaptureLost(wxMouseCaptureLostEvent& WXUNUSED(event))
+{
+	dragging = false;
+}
+
+// Redraw once the frame rendered in the background landed
+void DrawPane::eventTimer(wxTimerEvent& WXUNUSED(event))
+{
+	if (parent->engineRender->busy())
+		return;
+	timer.Stop();
+	Refresh();
+}
+
 
 
 //
@@ -1086,15 +1585,22 @@ void DrawPane::render(wxDC& dc)
 	// Only draw if we have data
 	if (parent->engineData->elements() > 0)
 	{
-		// Set the frame's title
-		parent->frame->SetTitle(_T("Inkpad - ") + parent->getfile_load().GetName());
-
 		// Get available renders
 		vector<std::string> renders;
 		parent->engineRender->render_available(renders);
 
-		// Render the data using first available render
-		parent->engineRender->write(dc, renders[0]);
+		// Render the data using first available render (checking back later if it's not done yet)
+		if (!parent->engineRender->write(dc, renders[0]) && !timer.IsRunning())
+			timer.Start(RENDER_POLL);
+
+		// Only describe the data once per modification (counting the parameters walks all elements)
+		if (statusValid && statusGeneration == parent->engineData->generation())
+			return;
+		statusGeneration = parent->engineData->generation();
+		statusValid = true;
+
+		// Set the frame's title
+		parent->frame->SetTitle(_T("Inkpad - ") + parent->getfile_load().GetName());
 
 		// Adjust status bar
 		wxString statusbar;
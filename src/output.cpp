@@ -119,7 +119,7 @@ void Output::data_output_svg(std::ofstream& stream) const
 	stream << "<rect x=\"0\" y=\"0\" width=\"" << data->imgSizeX << "\" height=\"" << data->imgSizeY << "\" fill=\"" << data->imgBackground.rgb_hex() << "\" stroke=\"" << data->imgBackground.rgb_hex() << "\" stroke-width=\"1px\" />\n";
 
 	// Process all elements
-	list<Element>::const_iterator tempIterator = data->begin();
+	Data::const_iterator tempIterator = data->begin();
 	while (tempIterator != data->end())
 	{
 		switch (tempIterator->identifier)
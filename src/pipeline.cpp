@@ -0,0 +1,214 @@
+/*
+ * pipeline.cpp
+ * Inkpad transformation pipeline.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Headers
+#include "pipeline.h"
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Construction and destruction
+//
+
+Pipeline::Pipeline()
+{
+}
+
+void Pipeline::clear()
+{
+	pipelineStages.clear();
+}
+
+
+//
+// Stages
+//
+
+void Pipeline::addRotate(double angle)
+{
+	Stage stage = {STAGE_ROTATE, angle, 0};
+	pipelineStages.push_back(stage);
+}
+
+void Pipeline::addTranslate(int dx, int dy)
+{
+	Stage stage = {STAGE_TRANSLATE, (double)dx, (double)dy};
+	pipelineStages.push_back(stage);
+}
+
+void Pipeline::addAutocrop()
+{
+	Stage stage = {STAGE_AUTOCROP, 0, 0};
+	pipelineStages.push_back(stage);
+}
+
+void Pipeline::addSimplify(double radius, Simplification method)
+{
+	Stage stage = {STAGE_SIMPLIFY, radius, (double)method};
+	pipelineStages.push_back(stage);
+}
+
+void Pipeline::addFit(double error)
+{
+	if (error < 0)
+		throw Exception("pipeline", "addFit", "error bound cannot be negative");
+	Stage stage = {STAGE_FIT, error, 0};
+	pipelineStages.push_back(stage);
+}
+
+void Pipeline::addSmoothn(double tension)
+{
+	if (tension == 0)
+		throw Exception("pipeline", "addSmoothn", "tension cannot be zero");
+	Stage stage = {STAGE_SMOOTHN, tension, 0};
+	pipelineStages.push_back(stage);
+}
+
+// Whether a stage operates on individual points
+bool Pipeline::fusable(const Stage& stage)
+{
+	return stage.type == STAGE_ROTATE || stage.type == STAGE_TRANSLATE || stage.type == STAGE_AUTOCROP;
+}
+
+
+//
+// Execution
+//
+
+bool Pipeline::empty() const
+{
+	return pipelineStages.empty();
+}
+
+// Apply all stages to a data object (safe to call concurrently on distinct objects)
+void Pipeline::run(Data& data) const
+{
+	unsigned int it = 0;
+	while (it < pipelineStages.size())
+	{
+		// Fuse all consecutive per-point stages
+		if (fusable(pipelineStages[it]))
+		{
+			unsigned int end = it + 1;
+			while (end < pipelineStages.size() && fusable(pipelineStages[end]))
+				end++;
+			run_fused(data, it, end);
+			it = end;
+			continue;
+		}
+
+		// Run element stages on their own
+		const Stage& stage = pipelineStages[it];
+		switch (stage.type)
+		{
+			case STAGE_SIMPLIFY:
+				data.simplify_polyline(stage.a, (Simplification)(int)stage.b);
+				break;
+			case STAGE_FIT:
+				data.fit_polyline(stage.a);
+				break;
+			case STAGE_SMOOTHN:
+				data.smoothn_polyline(stage.a);
+				break;
+			default:
+				throw Exception("pipeline", "run", "unknown stage");
+		}
+		it++;
+	}
+}
+
+// Apply a group of per-point stages, with a single write pass
+void Pipeline::run_fused(Data& data, unsigned int begin, unsigned int end) const
+{
+	// Collect the linear part of the transformation at every crop
+	vector<Affine> crops;
+	Affine linear;
+	for (unsigned int it = begin; it < end; it++)
+	{
+		const Stage& stage = pipelineStages[it];
+		if (stage.type == STAGE_ROTATE)
+			linear = Affine::rotation(stage.a) * linear;
+		if (stage.type == STAGE_ROTATE || stage.type == STAGE_AUTOCROP)
+			crops.push_back(linear);
+	}
+
+	// Calculate the bounds at all crops at once
+	vector<Bounds> bounds;
+	if (!crops.empty())
+		data.bounds(crops, bounds);
+
+	// Resolve all offsets, and compose the full transformation
+	Affine matrix;
+	int sizeX = data.imgSizeX, sizeY = data.imgSizeY;
+	unsigned int crop = 0;
+	for (unsigned int it = begin; it < end; it++)
+	{
+		const Stage& stage = pipelineStages[it];
+		switch (stage.type)
+		{
+			case STAGE_ROTATE:
+				matrix = Affine::translation(-(sizeX/2), -(sizeY/2)) * matrix;
+				matrix = Affine::rotation(stage.a) * matrix;
+				break;
+			case STAGE_TRANSLATE:
+				matrix = Affine::translation(stage.a, stage.b) * matrix;
+				break;
+			default:
+				break;
+		}
+
+		if (stage.type == STAGE_ROTATE || stage.type == STAGE_AUTOCROP)
+		{
+			// The bounds only differ by the offsets accumulated so far
+			int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+			const Bounds& current = bounds[crop++];
+			if (current.valid())
+			{
+				x0 = (int)(current.x0 + matrix.x0);
+				y0 = (int)(current.y0 + matrix.y0);
+				x1 = (int)(current.x1 + matrix.x0);
+				y1 = (int)(current.y1 + matrix.y0);
+			}
+
+			matrix = Affine::translation(-x0, -y0) * matrix;
+			sizeX = x1 - x0;
+			sizeY = y1 - y0;
+		}
+	}
+
+	// Write out the result
+	if (!matrix.identity())
+		data.transform(matrix);
+	data.imgSizeX = sizeX;
+	data.imgSizeY = sizeY;
+}
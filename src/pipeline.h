@@ -0,0 +1,111 @@
+/*
+ * pipeline.h
+ * Inkpad transformation pipeline.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Fusing stages
+ * ~~~~~~~~~~~~~
+ *
+ * A pipeline is a list of stages, applied in order. Consecutive per-point
+ * stages (rotations, translations and crops) get fused: their linear parts
+ * are known up front, so the bounds every crop needs can be calculated in
+ * one read-only sweep over the coordinates, after which all offsets get
+ * resolved and the composed transformation is written out in one single
+ * pass. Stages operating on whole elements (simplification, curve fitting,
+ * smoothing) break a fused group, and run on their own.
+ *
+ * The stages behave like their counterparts in the Data class: a rotation
+ * turns around the image center and crops afterwards, and crops truncate
+ * the bounds to integer values.
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Include guard
+#ifndef __PIPELINE
+#define __PIPELINE
+
+// Application headers
+#include "exception.h"
+#include "data.h"
+#include "transform.h"
+
+// Containers
+#include <vector>
+using std::vector;
+
+
+//////////////////////
+// CLASS DEFINITION //
+//////////////////////
+
+class Pipeline
+{
+	public:
+		// Construction and destruction
+		Pipeline();
+		void clear();
+
+		// Stages
+		void addRotate(double angle);
+		void addTranslate(int dx, int dy);
+		void addAutocrop();
+		void addSimplify(double radius, Simplification method = SIMPLIFY_DOUGLAS_PEUCKER);
+		void addFit(double error);
+		void addSmoothn(double tension);
+
+		// Execution
+		bool empty() const;
+		void run(Data&) const;
+
+	private:
+		// Stage description
+		enum StageType
+		{
+			STAGE_ROTATE,
+			STAGE_TRANSLATE,
+			STAGE_AUTOCROP,
+			STAGE_SIMPLIFY,
+			STAGE_FIT,
+			STAGE_SMOOTHN
+		};
+		struct Stage
+		{
+			StageType type;
+			double a, b;
+		};
+		static bool fusable(const Stage&);
+
+		// Execution of a group of per-point stages
+		void run_fused(Data&, unsigned int begin, unsigned int end) const;
+
+		vector<Stage> pipelineStages;
+};
+
+
+// Include guard
+#endif
@@ -30,6 +30,48 @@
 
 // Headers
 #include "render.h"
+#include <algorithm>
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+// Compare two colours
+inline bool help_same_colour(const Colour& a, const Colour& b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// Draw a batch of elements (filled points, or stroked lines and curves)
+#ifdef RENDER_CAIRO
+inline void help_flush_cairo(cairo_t* cr, int kind)
+{
+	if (kind == 1)
+		cairo_fill(cr);
+	else
+		cairo_stroke(cr);
+}
+#endif
+
+// Identify a pen style
+#ifdef RENDER_WXWIDGETS
+inline unsigned long long help_pen_key(const Colour& colour, int width)
+{
+	return ((unsigned long long)((colour.r << 16) | (colour.g << 8) | colour.b) << 32) | (unsigned int)width;
+}
+
+// Convert the parameters of an element into a list of points (reusing its memory)
+inline void help_points(const Parameters& parameters, vector<wxPoint>& points)
+{
+	points.resize(parameters.size() / 2);
+	for (unsigned int i = 0; i+1 < parameters.size(); i+=2)
+	{
+		points[i/2].x = parameters[i];
+		points[i/2].y = parameters[i+1];
+	}
+}
+#endif
 
 
 ////////////////////
@@ -40,8 +82,49 @@
 // Construction and destruction
 //
 
-Render::Render()
+Render::Render() : tiled(true), background(false), cacheValid(false), cacheScale(0), data(0)
+{
+	#ifdef RENDER_CAIRO
+	cairoSurface = 0;
+	#endif
+	#ifdef RENDER_BACKGROUND
+	asyncWorker = 0;
+	asyncStop = false;
+	asyncQueued = false;
+	asyncBusy = false;
+	asyncTicket = 0;
+	asyncDataGeneration = 0;
+	asyncDone = false;
+	asyncSurface = 0;
+	cancelTicket = 0;
+	cancelOwn = 0;
+	#endif
+	reset();
+}
+
+Render::~Render()
 {
+	// Stop the background worker
+	#ifdef RENDER_BACKGROUND
+	if (asyncWorker)
+	{
+		{
+			std::lock_guard<std::mutex> lock(asyncLock);
+			asyncStop = true;
+			asyncTicket++;
+		}
+		asyncWake.notify_one();
+		asyncThread.join();
+		delete asyncWorker;
+	}
+	if (asyncSurface)
+		cairo_surface_destroy(asyncSurface);
+	#endif
+
+	#ifdef RENDER_CAIRO
+	if (cairoSurface)
+		cairo_surface_destroy(cairoSurface);
+	#endif
 }
 
 
@@ -53,34 +136,95 @@ Render::Render()
 void Render::setData(Data* inputDataPointer)
 {
 	data = inputDataPointer;
+	invalidate();
 }
 
-// Write the data to a wxWidgets draw container
-void Render::write(wxDC& dc, const std::string render) const
+// Write the data to a wxWidgets draw container (false if it shows a previous frame, until the current one
+//   got rendered in the background)
+bool Render::write(wxDC& dc, const std::string render) const
 {
-	// Get the current image's size
-	float maxX = (float)data->imgSizeX;
-	float maxY = (float)data->imgSizeY;
-
 	// Get the size of the DC in pixels
 	int w, h;
 	dc.GetSize(&w, &h);
+	if (w <= 0 || h <= 0)
+		return true;
+
+	// Describe the frame
+	Frame frame;
+	frame.render = render;
+	frame.generation = data->generation();
+	frame.imgSizeX = data->imgSizeX;
+	frame.imgSizeY = data->imgSizeY;
+	frame.width = w;
+	frame.height = h;
+	frame.zoom = viewZoom;
+	frame.x = viewX;
+	frame.y = viewY;
+	frame.fit = viewFit;
+
+	// Render it, unless the previous frame looks the same
+	if (!cacheValid || !(frame == cacheFrame))
+	{
+		// In the background (showing the previous frame until the new one lands)
+		#ifdef RENDER_BACKGROUND
+		if (background && render == "cairo")
+		{
+			if (!collect(frame))
+			{
+				request(frame);
+				preview(dc, w, h);
+				return false;
+			}
+		}
+		else
+		#endif
+		{
+			if (!cacheBitmap.IsOk() || cacheBitmap.GetWidth() != w || cacheBitmap.GetHeight() != h)
+				cacheBitmap.Create(w, h, 24);
+			draw(cacheBitmap, w, h, render);
+		}
 
-	// Calculate a suitable scaling factor
-	float scaleX=(float)(w/maxX);
-	float scaleY=(float)(h/maxY);
+		cacheFrame = frame;
+		cacheValid = true;
+		view(w, h, cacheScale, cacheOriginX, cacheOriginY);
+	}
 
-	// Use x or y scaling factor, whichever fits on the DC (but beware of 10% margin)
-	float actualScale = wxMin(scaleX,scaleY)*0.95;
+	// Blit it to the screen
+	dc.DrawBitmap(cacheBitmap, 0, 0, false);
+	return true;
+}
 
-	// Calculate the new dimensins
-	int width = maxX * actualScale + 0.5;
-	int height = maxY * actualScale + 0.5;
+// Drop the cached frame (so the next one gets rendered for sure)
+void Render::invalidate()
+{
+	cacheValid = false;
+
+	// Forget about frames in the background as well, and the data they got rendered from
+	#ifdef RENDER_BACKGROUND
+	std::lock_guard<std::mutex> lock(asyncLock);
+	asyncTicket++;
+	asyncDone = false;
+	asyncError = std::exception_ptr();
+	asyncData.reset();
+	#endif
+}
 
-	// Center the image
-	float posX = (float)((w - (maxX*actualScale))/2.0);
-	float posY = (float)((h - (maxY*actualScale))/2.0);
-	dc.SetDeviceOrigin((long)posX, (long)posY);
+// Render a frame
+void Render::draw(wxBitmap& target, int w, int h, const std::string render) const
+{
+	// Place the page, and clear the window around its visible part
+	double scale, originX, originY;
+	int x0, y0, x1, y1;
+	view(w, h, scale, originX, originY);
+	extent(w, h, scale, originX, originY, x0, y0, x1, y1);
+	wxMemoryDC dc;
+	dc.SelectObject(target);
+	margins(dc, w, h, x0, y0, x1, y1);
+	if (x1 == x0)
+	{
+		dc.SelectObject(wxNullBitmap);
+		return;
+	}
 
 	// Bogus if
 	if (false)
@@ -91,43 +235,10 @@ void Render::write(wxDC& dc, const std::string render) const
 	#ifdef RENDER_CAIRO
 	else if (render == "cairo")
 	{
-		// Surface format
-		cairo_format_t format = CAIRO_FORMAT_RGB24;
-
-		// Create the buffers
-		unsigned char *dataCairo = new unsigned char[width*height*4];
-		unsigned char *dataWx = new unsigned char[width*height*3];
-
-		// Create a surface
-		cairo_surface_t* surface;
-		surface = cairo_image_surface_create_for_data(dataCairo, format, width, height, width*4);
-
-		// Create cairo object
-		cairo_t* cr;
-		cr = cairo_create(surface);
-
-		// Draw
-		render_output_cairo(cr, actualScale);
-
-		// Convert from Cairo RGB24 format to wxImage BGR format.
-		for (int y=0; y<height; y++)
-		{
-			for (int x=0; x<width; x++)
-			{
-				dataWx[x*3+y*width*3] = dataCairo[x*4+2+y*width*4];
-				dataWx[x*3+1+y*width*3] = dataCairo[x*4+1+y*width*4];
-				dataWx[x*3+2+y*width*3] = dataCairo[x*4+y*width*4];
-			}
-		}
-
-		// Blit final image to the screen.
-		wxBitmap m_bitmap(wxImage(width, height, dataWx, true));
-		dc.DrawBitmap(m_bitmap, 0, 0, true);
-
-		// Cleanup
-		delete[] dataWx, dataCairo;
-		cairo_destroy(cr);
-		cairo_surface_destroy(surface);
+		// The bitmap gets written directly
+		dc.SelectObject(wxNullBitmap);
+		raster(w, h, scale, originX, originY, x0, y0, x1, y1);
+		copy(cairoSurface, target, x0, y0, x1, y1);
 	}
 	#endif
 
@@ -135,24 +246,36 @@ void Render::write(wxDC& dc, const std::string render) const
 	#ifdef RENDER_WXWIDGETS
 	else if (render == "wxwidgets")
 	{
+		int width = x1 - x0;
+		int height = y1 - y0;
+
+		// Look up the elements within the visible part, and how much detail they need
+		vector<unsigned int> visible;
+		data->query(area(x0, y0, x1, y1, scale, originX, originY), visible);
+		unsigned int level = data->detail(RENDER_DETAIL / scale);
+
 		// Create a temporary DC to draw on
 		wxMemoryDC dc_mem;
 
-		// Set the scale and origin
-		dc_mem.SetUserScale(actualScale, actualScale);
-
-		// Attach a bitmap to that DC
-		wxBitmap dc_bitmap(maxX*actualScale, maxY*actualScale);
+		// Attach a bitmap to that DC (covering the visible part)
+		wxBitmap dc_bitmap(width, height);
 		dc_mem.SelectObject(dc_bitmap);
 
+		// Set the scale and origin
+		dc_mem.SetUserScale(scale, scale);
+		dc_mem.SetDeviceOrigin((long)(originX - x0), (long)(originY - y0));
+
 		// Draw
-		render_output_dc(dc_mem);
+		render_output_dc(dc_mem, level, visible);
 
 		// Copy the temporary DC's content to the actual DC
-		dc.Blit(wxPoint(0, 0), wxSize(maxX, maxY), &dc_mem, wxPoint(0, 0), wxCOPY);
+		dc_mem.SetUserScale(1, 1);
+		dc_mem.SetDeviceOrigin(0, 0);
+		dc.Blit(wxPoint(x0, y0), wxSize(width, height), &dc_mem, wxPoint(0, 0), wxCOPY);
 
-		// Destruct the memory DC
+		// Destruct the memory DCs
 		dc_mem.SelectObject(wxNullBitmap);
+		dc.SelectObject(wxNullBitmap);
 	}
 	#endif
 
@@ -160,7 +283,368 @@ void Render::write(wxDC& dc, const std::string render) const
 	// TODO: this throw is not catched
 	else
 	{
-	    throw Exception("render", "write", "invalid render specified");
+	    throw Exception("render", "draw", "invalid render specified");
+	}
+}
+
+// The visible part of the page, in device pixels (all zero if there is none)
+void Render::extent(int w, int h, double scale, double originX, double originY, int& x0, int& y0, int& x1, int& y1) const
+{
+	x0 = std::max(0, (int)floor(originX));
+	y0 = std::max(0, (int)floor(originY));
+	x1 = std::min(w, (int)ceil(originX + data->imgSizeX*scale));
+	y1 = std::min(h, (int)ceil(originY + data->imgSizeY*scale));
+	if (x1 <= x0 || y1 <= y0)
+		x0 = x1 = y0 = y1 = 0;
+}
+
+// Clear the window around the visible part of the page
+void Render::margins(wxDC& dc, int w, int h, int x0, int y0, int x1, int y1) const
+{
+	dc.SetPen(*wxTRANSPARENT_PEN);
+	dc.SetBrush(wxBrush(wxSystemSettings::GetColour(wxSYS_COLOUR_APPWORKSPACE)));
+	if (y0 > 0)
+		dc.DrawRectangle(0, 0, w, y0);
+	if (y1 < h)
+		dc.DrawRectangle(0, y1, w, h - y1);
+	if (x0 > 0)
+		dc.DrawRectangle(0, y0, x0, y1 - y0);
+	if (x1 < w)
+		dc.DrawRectangle(x1, y0, w - x1, y1 - y0);
+}
+
+// Draw the visible part of the page onto the Cairo surface (without touching wxWidgets, so it can
+//   happen in the background)
+#ifdef RENDER_CAIRO
+void Render::raster(int w, int h, double scale, double originX, double originY, int x0, int y0, int x1, int y1) const
+{
+	// Reuse the surface, as long as the window keeps its size
+	if (cairoSurface && (cairo_image_surface_get_width(cairoSurface) != w || cairo_image_surface_get_height(cairoSurface) != h))
+	{
+		cairo_surface_destroy(cairoSurface);
+		cairoSurface = 0;
+	}
+	if (!cairoSurface)
+		cairoSurface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
+
+	// Look up the elements within the visible part, and how much detail they need
+	vector<unsigned int> visible;
+	data->query(area(x0, y0, x1, y1, scale, originX, originY), visible);
+	unsigned int level = data->detail(RENDER_DETAIL / scale);
+
+	// Draw them
+	render_tiles_cairo(cairoSurface, x0, y0, x1, y1, scale, level, originX, originY, visible);
+	cairo_surface_flush(cairoSurface);
+}
+
+// Copy part of a Cairo surface into a bitmap (Cairo's RGB24 pixels are native-endian 32-bit words)
+void Render::copy(cairo_surface_t* surface, wxBitmap& target, int x0, int y0, int x1, int y1) const
+{
+	wxNativePixelData pixels(target);
+	if (!pixels)
+		throw Exception("render", "copy", "cannot access the pixels of the frame");
+	const unsigned char* source = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	wxNativePixelData::Iterator row(pixels);
+	row.Offset(pixels, x0, y0);
+	for (int y = y0; y < y1; y++)
+	{
+		wxNativePixelData::Iterator pixel = row;
+		const uint32_t* word = (const uint32_t*)(source + y*stride) + x0;
+		for (int x = 0; x < x1 - x0; x++, ++pixel)
+		{
+			pixel.Red() = (word[x] >> 16) & 0xFF;
+			pixel.Green() = (word[x] >> 8) & 0xFF;
+			pixel.Blue() = word[x] & 0xFF;
+		}
+		row.OffsetY(pixels, 1);
+	}
+}
+#endif
+
+
+// Render the whole page onto an image surface, at a given scale (e.g. for printing or thumbnails)
+#ifdef RENDER_CAIRO
+void Render::write(cairo_surface_t* surface, double scale) const
+{
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS || cairo_image_surface_get_format(surface) != CAIRO_FORMAT_RGB24)
+		throw Exception("render", "write", "invalid target surface");
+
+	// The part of the surface covered by the page
+	int x1 = std::min(cairo_image_surface_get_width(surface), (int)ceil(data->imgSizeX*scale));
+	int y1 = std::min(cairo_image_surface_get_height(surface), (int)ceil(data->imgSizeY*scale));
+	if (x1 <= 0 || y1 <= 0)
+		return;
+
+	// Draw it
+	vector<unsigned int> visible;
+	data->query(area(0, 0, x1, y1, scale, 0, 0), visible);
+	unsigned int level = data->detail(RENDER_DETAIL / scale);
+	cairo_surface_flush(surface);
+	render_tiles_cairo(surface, 0, 0, x1, y1, scale, level, 0, 0, visible);
+}
+#endif
+
+
+//
+// Background rendering
+//
+
+// Whether a frame is being rendered in the background
+bool Render::busy() const
+{
+	#ifdef RENDER_BACKGROUND
+	std::lock_guard<std::mutex> lock(asyncLock);
+	return asyncBusy;
+	#else
+	return false;
+	#endif
+}
+
+// Whether the frame being drawn got superseded (only frames in the background can be)
+bool Render::cancelled() const
+{
+	#ifdef RENDER_BACKGROUND
+	return cancelTicket && *cancelTicket != cancelOwn;
+	#else
+	return false;
+	#endif
+}
+
+#ifdef RENDER_BACKGROUND
+
+// Have a frame rendered in the background (superseding the one being rendered)
+void Render::request(const Frame& frame) const
+{
+	std::lock_guard<std::mutex> lock(asyncLock);
+	if (asyncBusy && asyncFrame == frame)
+		return;
+
+	// Take a snapshot of the data, once per modification
+	if (!asyncData || asyncDataGeneration != frame.generation)
+	{
+		asyncData = std::make_shared<Data>(*data);
+		asyncDataGeneration = frame.generation;
+	}
+
+	// Start the worker upon the first request
+	if (!asyncWorker)
+	{
+		asyncWorker = new Render;
+		asyncThread = std::thread(&Render::work, this);
+	}
+
+	asyncFrame = frame;
+	asyncTicket++;
+	asyncQueued = true;
+	asyncBusy = true;
+	asyncWake.notify_one();
+}
+
+// Move a frame which landed into the cache (false if it hasn't landed yet)
+bool Render::collect(const Frame& frame) const
+{
+	std::lock_guard<std::mutex> lock(asyncLock);
+
+	// Errors in the background surface here
+	if (asyncError && asyncDoneFrame == frame)
+	{
+		std::exception_ptr error = asyncError;
+		asyncError = std::exception_ptr();
+		std::rethrow_exception(error);
+	}
+	if (!asyncDone || !(asyncDoneFrame == frame))
+		return false;
+	asyncDone = false;
+
+	// Fill the cached bitmap
+	if (!cacheBitmap.IsOk() || cacheBitmap.GetWidth() != frame.width || cacheBitmap.GetHeight() != frame.height)
+		cacheBitmap.Create(frame.width, frame.height, 24);
+	double scale, originX, originY;
+	int x0, y0, x1, y1;
+	view(frame.width, frame.height, scale, originX, originY);
+	extent(frame.width, frame.height, scale, originX, originY, x0, y0, x1, y1);
+	wxMemoryDC dc;
+	dc.SelectObject(cacheBitmap);
+	margins(dc, frame.width, frame.height, x0, y0, x1, y1);
+	dc.SelectObject(wxNullBitmap);
+	if (x1 > x0)
+		copy(asyncSurface, cacheBitmap, x0, y0, x1, y1);
+	return true;
+}
+
+// Show the last finished frame, mapped onto the current view (until the new one lands)
+void Render::preview(wxDC& dc, int w, int h) const
+{
+	if (cacheScale <= 0)
+	{
+		margins(dc, w, h, 0, 0, 0, 0);
+		return;
+	}
+
+	// Where it ends up
+	double scale, originX, originY;
+	view(w, h, scale, originX, originY);
+	double factor = scale / cacheScale;
+	int x0 = (int)floor(originX - cacheOriginX*factor);
+	int y0 = (int)floor(originY - cacheOriginY*factor);
+	int width = (int)ceil(cacheBitmap.GetWidth()*factor);
+	int height = (int)ceil(cacheBitmap.GetHeight()*factor);
+
+	// Clear the window around it, and stretch it into place
+	int visibleX0 = std::max(x0, 0), visibleY0 = std::max(y0, 0);
+	int visibleX1 = std::min(x0 + width, w), visibleY1 = std::min(y0 + height, h);
+	if (visibleX1 <= visibleX0 || visibleY1 <= visibleY0)
+		visibleX0 = visibleY0 = visibleX1 = visibleY1 = 0;
+	margins(dc, w, h, visibleX0, visibleY0, visibleX1, visibleY1);
+	wxMemoryDC source;
+	source.SelectObject(cacheBitmap);
+	dc.StretchBlit(x0, y0, width, height, &source, 0, 0, cacheBitmap.GetWidth(), cacheBitmap.GetHeight());
+	source.SelectObject(wxNullBitmap);
+}
+
+// Render the requested frames one at a time, with a render of its own (in a thread of its own)
+void Render::work() const
+{
+	std::unique_lock<std::mutex> lock(asyncLock);
+	while (true)
+	{
+		asyncWake.wait(lock, [this]() { return asyncStop || asyncQueued; });
+		if (asyncStop)
+			return;
+
+		// Take the newest request
+		Frame frame = asyncFrame;
+		std::shared_ptr<Data> snapshot = asyncData;
+		unsigned int ticket = asyncTicket;
+		asyncQueued = false;
+		lock.unlock();
+
+		// Render it from the snapshot (the worker owns it meanwhile, caches included), unless the render got
+		//   invalidated before the worker got to it
+		std::exception_ptr error;
+		if (snapshot)
+		{
+			asyncWorker->data = snapshot.get();
+			asyncWorker->viewZoom = frame.zoom;
+			asyncWorker->viewX = frame.x;
+			asyncWorker->viewY = frame.y;
+			asyncWorker->viewFit = frame.fit;
+			asyncWorker->cancelTicket = &asyncTicket;
+			asyncWorker->cancelOwn = ticket;
+			try
+			{
+				double scale, originX, originY;
+				int x0, y0, x1, y1;
+				asyncWorker->view(frame.width, frame.height, scale, originX, originY);
+				asyncWorker->extent(frame.width, frame.height, scale, originX, originY, x0, y0, x1, y1);
+				if (x1 > x0)
+					asyncWorker->raster(frame.width, frame.height, scale, originX, originY, x0, y0, x1, y1);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+		}
+
+		// Hand it over, unless it got superseded meanwhile
+		lock.lock();
+		if (snapshot && asyncTicket == ticket)
+		{
+			if (error)
+				asyncError = error;
+			else
+				std::swap(asyncSurface, asyncWorker->cairoSurface);
+			asyncDone = !error;
+			asyncDoneFrame = frame;
+		}
+		if (!asyncQueued)
+			asyncBusy = false;
+	}
+}
+
+#endif
+
+
+//
+// Viewport
+//
+
+// Fit the whole page in the window
+void Render::reset()
+{
+	viewZoom = 1;
+	viewX = 0;
+	viewY = 0;
+	viewFit = true;
+}
+
+// Zoom around the center of the window
+void Render::zoom(double factor, int width, int height)
+{
+	zoom(factor, width, height, width/2, height/2);
+}
+
+// Zoom around a position in the window (which keeps showing the same point of the page)
+void Render::zoom(double factor, int width, int height, int x, int y)
+{
+	detach();
+	double scale, originX, originY;
+	view(width, height, scale, originX, originY);
+
+	// The point of the page under the position
+	double pointX = (x - originX) / scale;
+	double pointY = (y - originY) / scale;
+
+	// Scale the view, and move that point back under the position
+	viewZoom = std::min(std::max(viewZoom * factor, RENDER_ZOOM_MINIMUM), RENDER_ZOOM_MAXIMUM);
+	view(width, height, scale, originX, originY);
+	viewX += pointX - (x - originX) / scale;
+	viewY += pointY - (y - originY) / scale;
+}
+
+// Move the page along with the mouse
+void Render::pan(int dx, int dy, int width, int height)
+{
+	detach();
+	double scale, originX, originY;
+	view(width, height, scale, originX, originY);
+	viewX -= dx / scale;
+	viewY -= dy / scale;
+}
+
+// Place the page within a window: the scale, and where the origin of the page ends up
+void Render::view(int width, int height, double& scale, double& originX, double& originY) const
+{
+	double maxX = std::max(data->imgSizeX, 1);
+	double maxY = std::max(data->imgSizeY, 1);
+	scale = std::min(width/maxX, height/maxY) * RENDER_FIT * viewZoom;
+
+	double centerX = viewFit ? maxX/2 : viewX;
+	double centerY = viewFit ? maxY/2 : viewY;
+	originX = width/2.0 - centerX*scale;
+	originY = height/2.0 - centerY*scale;
+}
+
+// The part of the page which ends up in a rectangle of device pixels (widened, as strokes reach half their
+//   width beyond their points)
+Bounds Render::area(int x0, int y0, int x1, int y1, double scale, double originX, double originY) const
+{
+	Bounds region;
+	double margin = std::max(data->widest() / 2.0, 1.0) + 1/scale;
+	region.add((x0 - originX)/scale - margin, (y0 - originY)/scale - margin);
+	region.add((x1 - originX)/scale + margin, (y1 - originY)/scale + margin);
+	return region;
+}
+
+// Stop following the page (before zooming or panning away from it)
+void Render::detach()
+{
+	if (viewFit)
+	{
+		viewX = std::max(data->imgSizeX, 1) / 2.0;
+		viewY = std::max(data->imgSizeY, 1) / 2.0;
+		viewFit = false;
 	}
 }
 
@@ -188,54 +672,145 @@ void Render::render_available(vector<std::string>& data) const
 // Data processing
 //
 
-// Output data to Cairo surface
+// Draw a rectangle of device pixels onto a Cairo image surface, splitting it into tiles drawn in parallel
 #ifdef RENDER_CAIRO
-void Render::render_output_cairo(cairo_t* cr, float scale) const
+void Render::render_tiles_cairo(cairo_surface_t* surface, int x0, int y0, int x1, int y1, double scale, unsigned int level, double originX, double originY, const vector<unsigned int>& elements) const
 {
-	// Clear the surface
+	unsigned int columns = (x1 - x0 + RENDER_TILE - 1) / RENDER_TILE;
+	unsigned int rows = (y1 - y0 + RENDER_TILE - 1) / RENDER_TILE;
+	unsigned int tiles = columns * rows;
 
-	// Draw the background
+	// A single pass, if there is nothing to gain
+	if (!tiled || tiles < 2 || Pool::active() || Pool::instance().size() < 2)
+	{
+		cairo_t* cr = cairo_create(surface);
+		cairo_rectangle(cr, x0, y0, x1 - x0, y1 - y0);
+		cairo_clip(cr);
+		cairo_translate(cr, originX, originY);
+		render_output_cairo(cr, scale, level, elements);
+		cairo_destroy(cr);
+		return;
+	}
+
+	// Bucket the elements by tile
+	vector< vector<unsigned int> > buckets(tiles);
+	for (unsigned int tile = 0; tile < tiles; tile++)
+	{
+		int tileX0 = x0 + (tile % columns)*RENDER_TILE, tileY0 = y0 + (tile / columns)*RENDER_TILE;
+		int tileX1 = std::min(tileX0 + (int)RENDER_TILE, x1), tileY1 = std::min(tileY0 + (int)RENDER_TILE, y1);
+		data->query(area(tileX0, tileY0, tileX1, tileY1, scale, originX, originY), buckets[tile]);
+	}
+
+	// Draw all tiles in parallel, every one on a surface sharing the pixels of its part of the target
+	//   (tiles are aligned to whole pixels, so Cairo's coverage at their edges adds up seamlessly)
+	unsigned char* pixels = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	Pool::instance().parallel_for(tiles, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int tile = begin; tile < end && !cancelled(); tile++)
+		{
+			int tileX0 = x0 + (tile % columns)*RENDER_TILE, tileY0 = y0 + (tile / columns)*RENDER_TILE;
+			int tileX1 = std::min(tileX0 + (int)RENDER_TILE, x1), tileY1 = std::min(tileY0 + (int)RENDER_TILE, y1);
+			cairo_surface_t* part = cairo_image_surface_create_for_data(pixels + tileY0*stride + tileX0*4,
+				CAIRO_FORMAT_RGB24, tileX1 - tileX0, tileY1 - tileY0, stride);
+			cairo_t* cr = cairo_create(part);
+			cairo_translate(cr, originX - tileX0, originY - tileY0);
+			render_output_cairo(cr, scale, level, buckets[tile]);
+			cairo_destroy(cr);
+			cairo_surface_finish(part);
+			cairo_surface_destroy(part);
+		}
+	});
+	cairo_surface_mark_dirty(surface);
+}
+
+// Output data to Cairo surface
+void Render::render_output_cairo(cairo_t* cr, double scale, unsigned int level, const vector<unsigned int>& elements) const
+{
+	// Clear the surface (the surface gets reused, and the edge of the page stays black)
 	cairo_set_source_rgb(cr, BLACK.r, BLACK.g, BLACK.b);
+	cairo_paint(cr);
+
+	// Draw the background
 	cairo_set_line_width(cr, 1);
 	cairo_rectangle(cr, 1, 1, scale*data->imgSizeX-2, scale*data->imgSizeY-2);
 	cairo_set_source_rgb(cr, data->imgBackground.r, data->imgBackground.b, data->imgBackground.g);
 	cairo_fill(cr);
 
-	// Process all elements
-	list<Element>::const_iterator tempIterator = data->begin();
-	while (tempIterator != data->end())
+	// Process the visible elements, collecting consecutive ones of the same style into a single path
+	int batch = 0;
+	Colour batchColour;
+	int batchWidth = 0;
+	for (unsigned int it = 0; it < elements.size(); it++)
 	{
-		switch (tempIterator->identifier)
+		// Give up on superseded frames
+		if (it % RENDER_CANCEL == 0 && cancelled())
+			return;
+
+		Element element = data->element(elements[it], level);
+		if (element.parameters.empty())
+			continue;
+
+		// Points get filled, lines and curves stroked
+		int kind = (element.identifier == 1) ? 1 : 2;
+		bool same = batch == kind && help_same_colour(batchColour, element.foreground)
+			&& (kind == 1 || batchWidth == element.width);
+
+		// Draw the pending batch if the style changes
+		if (batch && !same)
+		{
+			help_flush_cairo(cr, batch);
+			batch = 0;
+		}
+		if (!batch)
+		{
+			cairo_set_source_rgb(cr, element.foreground.r, element.foreground.g, element.foreground.b);
+			if (kind == 2)
+				cairo_set_line_width(cr, scale*element.width);
+			batch = kind;
+			batchColour = element.foreground;
+			batchWidth = element.width;
+		}
+
+		switch (element.identifier)
 		{
 				// Point
 			case 1:
-				cairo_set_source_rgb(cr, tempIterator->foreground.r, tempIterator->foreground.g, tempIterator->foreground.b);
-				cairo_arc(cr, scale*tempIterator->parameters[0], scale*tempIterator->parameters[1], scale*1, 0, 2*M_PI);
-				cairo_fill(cr);
+				cairo_new_sub_path(cr);
+				cairo_arc(cr, scale*element.parameters[0], scale*element.parameters[1], scale*1, 0, 2*M_PI);
 				break;
 
 				// Polyline
 			case 2:
-				cairo_set_source_rgb(cr, tempIterator->foreground.r, tempIterator->foreground.g, tempIterator->foreground.b);
-				cairo_set_line_width(cr, scale*tempIterator->width);
-				cairo_move_to(cr, scale*tempIterator->parameters[0], scale*tempIterator->parameters[1]);
-				for (unsigned int i = 2; i < tempIterator->parameters.size(); i+=2)
-					cairo_line_to(cr, scale*tempIterator->parameters[i], scale*tempIterator->parameters[i+1]);
-				cairo_stroke(cr);
+				cairo_move_to(cr, scale*element.parameters[0], scale*element.parameters[1]);
+				for (unsigned int i = 2; i < element.parameters.size(); i+=2)
+					cairo_line_to(cr, scale*element.parameters[i], scale*element.parameters[i+1]);
+				break;
+
+				// Polybezier
+			case 3:
+				cairo_move_to(cr, scale*element.parameters[0], scale*element.parameters[1]);
+				for (unsigned int i = 2; i+5 < element.parameters.size(); i+=6)
+					cairo_curve_to(cr, scale*element.parameters[i], scale*element.parameters[i+1],
+						scale*element.parameters[i+2], scale*element.parameters[i+3],
+						scale*element.parameters[i+4], scale*element.parameters[i+5]);
 				break;
 
 				// Unsupported type
 			default:
-                throw Exception("render", "render_output_cairo", "unsupported element with ID " + stringify(tempIterator->identifier));
+                throw Exception("render", "render_output_cairo", "unsupported element with ID " + stringify(element.identifier));
 		}
-		++tempIterator;
 	}
+
+	// Draw the last batch
+	if (batch)
+		help_flush_cairo(cr, batch);
 }
 #endif
 
 // Output data to wxWidgets draw container
 #ifdef RENDER_WXWIDGETS
-void Render::render_output_dc(wxMemoryDC& dc) const
+void Render::render_output_dc(wxMemoryDC& dc, unsigned int level, const vector<unsigned int>& elements) const
 {
 	// Clear the DC
 	dc.Clear();
@@ -247,47 +822,55 @@ void Render::render_output_dc(wxMemoryDC& dc) const
 	dc.SetPen(wxPen(BLACK.rgb_wxColor(), 1));
 	dc.DrawRectangle(0, 0, data->imgSizeX-1, data->imgSizeY-1);
 
-	// Process all elements
-	list<Element>::const_iterator tempIterator = data->begin();
-	while (tempIterator != data->end())
+	// Process the visible elements (only switching pens when the style changes)
+	bool selected = false;
+	unsigned long long current = 0;
+	for (unsigned int it = 0; it < elements.size(); it++)
 	{
-		switch (tempIterator->identifier)
+		Element element = data->element(elements[it], level);
+		if (element.parameters.empty())
+			continue;
+
+		// Look up the pen
+		unsigned long long key = help_pen_key(element.foreground, element.width);
+		if (!selected || key != current)
+		{
+			std::map<unsigned long long, wxPen>::iterator pen = dcPens.find(key);
+			if (pen == dcPens.end())
+			{
+				if (dcPens.size() >= RENDER_PENS)
+					dcPens.clear();
+				pen = dcPens.insert(std::make_pair(key, wxPen(element.foreground.rgb_wxColor(), element.width))).first;
+			}
+			dc.SetPen(pen->second);
+			current = key;
+			selected = true;
+		}
+
+		switch (element.identifier)
 		{
 				// Point
 			case 1:
-				dc.SetPen(wxPen(tempIterator->foreground.rgb_wxColor(), tempIterator->width));
-				dc.DrawPoint(tempIterator->parameters[0], tempIterator->parameters[1]);
+				dc.DrawPoint(element.parameters[0], element.parameters[1]);
 				break;
 
 				// Polyline
 			case 2:
-				dc.SetPen(wxPen(tempIterator->foreground.rgb_wxColor(), tempIterator->width));
-				for (unsigned int i = 2; i < tempIterator->parameters.size(); i+=2)
-					dc.DrawLine(tempIterator->parameters[i-2], tempIterator->parameters[i-1], tempIterator->parameters[i], tempIterator->parameters[i+1]);
+				help_points(element.parameters, dcPoints);
+				if (dcPoints.size() > 1)
+					dc.DrawLines(dcPoints.size(), &dcPoints[0]);
 				break;
 
 				// Polybezier
 			case 3:
-			{
-				dc.SetPen(wxPen(tempIterator->foreground.rgb_wxColor(), tempIterator->width));
-				wxPoint* points = new wxPoint[tempIterator->parameters.size() / 2];
-				int count = 0;
-				for (unsigned int i = 0; i < tempIterator->parameters.size(); i+=2)
-				{
-					points[count].x = tempIterator->parameters[i];
-					points[count].y = tempIterator->parameters[i+1];
-					count++;
-				}
-				dc.DrawSpline(tempIterator->parameters.size()/2, points);
-				delete[] points;
+				help_points(element.parameters, dcPoints);
+				dc.DrawSpline(dcPoints.size(), &dcPoints[0]);
 				break;
-			}
 
 			// Unsupported type
 			default:
-                throw Exception("render", "render_output_wxwidgets", "unsupported element with ID " + stringify(tempIterator->identifier));
+                throw Exception("render", "render_output_wxwidgets", "unsupported element with ID " + stringify(element.identifier));
 		}
-		++tempIterator;
 	}
 }
 #endif
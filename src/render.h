@@ -20,6 +20,60 @@
  *
  */
 
+/*
+ * Viewport
+ * ~~~~~~~~
+ *
+ * The view on the page is described by a zoom factor, relative to the
+ * scale at which the whole page fits the window, and the point of the
+ * page (in image coordinates) shown at the center of the window. As long
+ * as the view hasn't been zoomed or panned, it keeps fitting the page,
+ * even when the page changes size.
+ *
+ * Only the part of the page which is visible gets rasterised, and only the
+ * elements whose bounds intersect it (widened with the largest pen) get
+ * drawn, as looked up through the spatial index of the data. The cost of
+ * a zoomed-in view is therefore proportional to what is visible, rather
+ * than to the size of the document. Zoomed out, polylines get drawn from
+ * the coarsest level of detail (see data.h) whose error stays below
+ * RENDER_DETAIL pixels, so the cost of an overview doesn't grow with the
+ * amount of points either.
+ *
+ * Tiled rendering
+ * ~~~~~~~~~~~~~~~
+ *
+ * The Cairo render splits larger areas into tiles of RENDER_TILE pixels,
+ * which get drawn in parallel on the thread pool. The elements get bucketed
+ * per tile through the spatial index first, and every tile is drawn on a
+ * surface of its own, which shares the pixels of its part of the target
+ * (so there is nothing left to composite afterwards). As tiles are aligned
+ * to whole pixels, the result is identical to drawing the area at once.
+ *
+ * Frame cache
+ * ~~~~~~~~~~~
+ *
+ * The last rendered frame is kept, along with what it depicts: the render
+ * engine, the generation of the data, the size of the page and of the
+ * window, and the viewport. Writing a frame which would look the same (for
+ * example when a window got uncovered) boils down to a blit.
+ *
+ * Background rendering
+ * ~~~~~~~~~~~~~~~~~~~~
+ *
+ * With background set, Cairo frames get rendered by a worker thread, so the
+ * window doesn't freeze on large documents or while it gets resized. Every
+ * request hands the worker a snapshot of the data (copied once per
+ * modification, so zooming and panning share it), which it renders with a
+ * render of its own onto an offscreen surface. A newer request supersedes
+ * the one being rendered: the worker checks for that between tiles and
+ * batches of elements, and drops the frame. Until the requested frame
+ * lands, write() shows the last finished one, stretched onto the current
+ * view, and returns false; busy() then tells when to check back. Only the
+ * worker touches the snapshot and its caches, while the pixels get copied
+ * into the bitmap by the thread writing the frame (as wxWidgets isn't
+ * thread-safe).
+ */
+
 ///////////////////
 // CONFIGURATION //
 ///////////////////
@@ -45,11 +99,37 @@
 // Application headers
 #include "exception.h"
 #include "generic.h"
+#include "threading.h"
 
 // Containers
 #include <vector>
 using std::vector;
 
+// Share of the window the page takes up when fitted
+const double RENDER_FIT = 0.95;
+
+// Zoom factor of a single zoom step
+const double RENDER_ZOOM_STEP = 1.25;
+
+// Zoom limits (relative to the fitted page)
+const double RENDER_ZOOM_MINIMUM = 0.1;
+const double RENDER_ZOOM_MAXIMUM = 1000;
+
+// Maximal error of the simplified polylines drawn (in pixels)
+const double RENDER_DETAIL = 0.5;
+
+// Size of the tiles drawn in parallel (in pixels)
+const unsigned int RENDER_TILE = 256;
+
+// Amount of pens kept by the wxWidgets render
+const unsigned int RENDER_PENS = 256;
+
+// Amount of elements drawn between checks whether a frame got superseded
+const unsigned int RENDER_CANCEL = 256;
+
+// Interval at which a window checks for frames rendered in the background (in milliseconds)
+const int RENDER_POLL = 15;
+
 
 //
 // Render engines
@@ -58,10 +138,19 @@ using std::vector;
 // Cairo
 #ifdef RENDER_CAIRO
 #include <cairo/cairo.h>
+#include <wx/rawbmp.h>
+#include <stdint.h>
 #endif
 
 // wxWidgets
 #ifdef RENDER_WXWIDGETS
+#include <map>
+#endif
+
+// Background rendering (which needs threads, and a render that keeps its hands off wxWidgets)
+#if defined(RENDER_CAIRO) && defined(WITH_THREADS)
+#define RENDER_BACKGROUND
+#include <memory>
 #endif
 
 
@@ -81,21 +170,105 @@ class Render
 	public:
 		// Construction and destruction
 		Render();
+		~Render();
+
+		// Configuration (draw larger areas in parallel tiles, render frames in the background, Cairo only)
+		bool tiled;
+		bool background;
 
 		// Class member routines
 		void setData(Data*);
-		void write(wxDC&, const std::string) const;
+		bool write(wxDC&, const std::string) const;
+		#ifdef RENDER_CAIRO
+		void write(cairo_surface_t*, double scale) const;
+		#endif
+		void invalidate();
+		bool busy() const;
+
+		// Viewport (given the size of the window, and positions within it)
+		void reset();
+		void zoom(double factor, int width, int height);
+		void zoom(double factor, int width, int height, int x, int y);
+		void pan(int dx, int dy, int width, int height);
 
 		// Informational routines
 		void render_available(vector<std::string>&) const;
 
 	private:
+		// Frame rendering
+		void draw(wxBitmap&, int width, int height, const std::string) const;
+		void extent(int width, int height, double scale, double originX, double originY, int& x0, int& y0, int& x1, int& y1) const;
+		void margins(wxDC&, int width, int height, int x0, int y0, int x1, int y1) const;
+		bool cancelled() const;
+		#ifdef RENDER_CAIRO
+		void raster(int width, int height, double scale, double originX, double originY, int x0, int y0, int x1, int y1) const;
+		void copy(cairo_surface_t*, wxBitmap&, int x0, int y0, int x1, int y1) const;
+		mutable cairo_surface_t* cairoSurface;
+		#endif
+
 		// Data processing
         #ifdef RENDER_CAIRO
-		void render_output_cairo(cairo_t*, float scale) const;
+		void render_tiles_cairo(cairo_surface_t*, int x0, int y0, int x1, int y1, double scale, unsigned int level, double originX, double originY, const vector<unsigned int>&) const;
+		void render_output_cairo(cairo_t*, double scale, unsigned int level, const vector<unsigned int>&) const;
 		#endif
 		#ifdef RENDER_WXWIDGETS
-		void render_output_dc(wxMemoryDC&) const;
+		void render_output_dc(wxMemoryDC&, unsigned int level, const vector<unsigned int>&) const;
+		mutable std::map<unsigned long long, wxPen> dcPens;
+		mutable vector<wxPoint> dcPoints;
+		#endif
+
+		// Viewport
+		void view(int width, int height, double& scale, double& originX, double& originY) const;
+		Bounds area(int x0, int y0, int x1, int y1, double scale, double originX, double originY) const;
+		void detach();
+		double viewZoom;
+		double viewX, viewY;
+		bool viewFit;
+
+		// Frame cache
+		struct Frame
+		{
+			std::string render;
+			unsigned int generation;
+			int imgSizeX, imgSizeY;
+			int width, height;
+			double zoom, x, y;
+			bool fit;
+
+			bool operator==(const Frame& other) const
+			{
+				return render == other.render && generation == other.generation
+					&& imgSizeX == other.imgSizeX && imgSizeY == other.imgSizeY
+					&& width == other.width && height == other.height
+					&& zoom == other.zoom && x == other.x && y == other.y && fit == other.fit;
+			}
+		};
+		mutable bool cacheValid;
+		mutable Frame cacheFrame;
+		mutable wxBitmap cacheBitmap;
+		mutable double cacheScale, cacheOriginX, cacheOriginY;
+
+		// Background rendering (the request, the frame which landed, and the state of the worker's own render)
+		#ifdef RENDER_BACKGROUND
+		void request(const Frame&) const;
+		bool collect(const Frame&) const;
+		void preview(wxDC&, int width, int height) const;
+		void work() const;
+		mutable Render* asyncWorker;
+		mutable std::thread asyncThread;
+		mutable std::mutex asyncLock;
+		mutable std::condition_variable asyncWake;
+		mutable bool asyncStop, asyncQueued, asyncBusy;
+		mutable std::atomic<unsigned int> asyncTicket;
+		mutable Frame asyncFrame;
+		mutable std::shared_ptr<Data> asyncData;
+		mutable unsigned int asyncDataGeneration;
+		mutable bool asyncDone;
+		mutable Frame asyncDoneFrame;
+		mutable cairo_surface_t* asyncSurface;
+		mutable std::exception_ptr asyncError;
+		const std::atomic<unsigned int>* cancelTicket;
+		unsigned int cancelOwn;
 		#endif
 
 		// Data
@@ -0,0 +1,383 @@
+/*
+ * stitch.cpp
+ * Inkpad polyline stitching.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Headers
+#include "stitch.h"
+#include <algorithm>
+#include <climits>
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+// Check whether an element can take part in a chain (points and polylines)
+inline bool help_chainable(const Store& store, unsigned int position)
+{
+	int identifier = store.identifier(position);
+	return (identifier == 1 || identifier == 2) && store.length(position) >= 2;
+}
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Construction and destruction
+//
+
+Stitch::Stitch(const Store& inputStore) : store(inputStore)
+{
+}
+
+
+//
+// Chaining
+//
+
+// Chain all elements, using a partition for every thread
+void Stitch::search()
+{
+	unsigned int partitions = Pool::active() ? 1 : Pool::instance().size();
+	unsigned int maximum = store.size() / STITCH_PARTITION_MINIMUM;
+	if (partitions > maximum)
+		partitions = maximum;
+	search(partitions);
+}
+
+// Chain all elements, using a given amount of partitions
+void Stitch::search(unsigned int partitions)
+{
+	// Index all start points
+	index();
+
+	// Reset the chains
+	unsigned int count = store.size();
+	chainMerged.assign(count, false);
+	chainNext.assign(count, -1);
+
+	// Process all elements serially
+	if (partitions > count)
+		partitions = count;
+	if (partitions <= 1)
+	{
+		for (unsigned int it = 0; it < count; it++)
+			if (!chainMerged[it] && help_chainable(store, it))
+				chain(it, count, false);
+		return;
+	}
+
+	// Chain every partition on its own
+	vector<unsigned int> borders(partitions + 1);
+	for (unsigned int partition = 0; partition <= partitions; partition++)
+		borders[partition] = (unsigned long long)count * partition / partitions;
+	localMerged.assign(count, false);
+	localNext.assign(count, -1);
+	localEscaped.assign(count, false);
+	localSkip = indexSkip;
+	Pool::instance().parallel_for(partitions, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int partition = first; partition < last; partition++)
+			for (unsigned int it = borders[partition]; it < borders[partition + 1]; it++)
+				if (!localMerged[it] && help_chainable(store, it))
+					chain(it, borders[partition + 1], true);
+	});
+
+	// Merge the partitions, in order
+	for (unsigned int partition = 0; partition < partitions; partition++)
+		replay(borders[partition], borders[partition + 1]);
+}
+
+// Build the chain of a given head, in the global or partition-local state
+void Stitch::chain(unsigned int head, unsigned int end, bool local)
+{
+	vector<char>& merged = local ? localMerged : chainMerged;
+	vector<int>& next = local ? localNext : chainNext;
+	vector<unsigned int>& skips = local ? localSkip : indexSkip;
+	if (!local)
+		chainClaims.clear();
+
+	// Save the end points
+	const double* parameters = store.parameters(head);
+	double x = parameters[store.length(head) - 2];
+	double y = parameters[store.length(head) - 1];
+	unsigned int tail = head;
+	bool escaped = false;
+
+	// Scan the following elements as long as the chain grows
+	bool grown;
+	do
+	{
+		grown = false;
+		unsigned int position = head;
+		while (true)
+		{
+			// Look for the first unmerged element following the current one, starting at the end point
+			int group = lookup(x, y);
+			if (group < 0)
+				break;
+			int member = local ? find_local(group, position, end, escaped) : find(group, position);
+			if (member < 0)
+				break;
+
+			// Merge it
+			unsigned int it2 = indexMembers[member];
+			skips[member] = member + 1;
+			merged[it2] = true;
+			next[tail] = it2;
+			tail = it2;
+			position = it2;
+			if (!local)
+				chainClaims.push_back(it2);
+
+			// Alter the new comparison points (only polylines with more than one point extend the chain)
+			if (store.identifier(it2) == 2 && store.length(it2) > 2)
+			{
+				const double* parameters2 = store.parameters(it2);
+				x = parameters2[store.length(it2) - 2];
+				y = parameters2[store.length(it2) - 1];
+				grown = true;
+			}
+		}
+	}
+	while (grown);
+
+	if (local)
+		localEscaped[head] = escaped;
+}
+
+// Merge the local chains of a partition into the global state
+void Stitch::replay(unsigned int begin, unsigned int end)
+{
+	// Preceding chains might already have claimed some elements
+	unsigned int differences = 0;
+	for (unsigned int it = begin; it < end; it++)
+		if (chainMerged[it])
+			differences++;
+
+	// Process all elements, tracking the local state as the serial scan would see it
+	vector<char> seen(end - begin, false);
+	for (unsigned int it = begin; it < end; it++)
+	{
+		bool chainable = help_chainable(store, it);
+		bool head = chainable && !seen[it - begin];
+
+		// Both states agree on all following elements, so the local chain is the global one
+		if (differences == 0 && head && !localEscaped[it])
+		{
+			unsigned int tail = it;
+			for (int it2 = localNext[it]; it2 >= 0; it2 = localNext[it2])
+			{
+				chainMerged[it2] = true;
+				seen[it2 - begin] = true;
+				indexSkip[indexSlot[it2]] = indexSlot[it2] + 1;
+				chainNext[tail] = it2;
+				tail = it2;
+			}
+		}
+
+		// The states differ, so rebuild the chain serially
+		else
+		{
+			// Pass the local chain
+			if (head)
+			{
+				for (int it2 = localNext[it]; it2 >= 0; it2 = localNext[it2])
+				{
+					if (chainMerged[it2])
+						differences--;
+					else
+						differences++;
+					seen[it2 - begin] = true;
+				}
+			}
+
+			// Build the global one
+			if (chainable && !chainMerged[it])
+			{
+				chain(it, store.size(), false);
+				for (unsigned int claim = 0; claim < chainClaims.size(); claim++)
+				{
+					unsigned int it2 = chainClaims[claim];
+					if (it2 >= end)
+						continue;
+					if (seen[it2 - begin])
+						differences--;
+					else
+						differences++;
+				}
+			}
+		}
+
+		// Leave the element behind
+		if (chainMerged[it] != seen[it - begin])
+			differences--;
+	}
+}
+
+
+//
+// Results
+//
+
+// Whether an element got merged into a preceding one
+bool Stitch::merged(unsigned int position) const
+{
+	return chainMerged[position] != 0;
+}
+
+const vector<char>& Stitch::merged() const
+{
+	return chainMerged;
+}
+
+// The element following a given one within its chain (or -1)
+int Stitch::next(unsigned int position) const
+{
+	return chainNext[position];
+}
+
+
+//
+// Index
+//
+
+// Group all chainable elements by their start point
+void Stitch::index()
+{
+	// Assign a group to every start point
+	unsigned int count = store.size();
+	vector<int> groups(count, -1);
+	indexGroups.clear();
+	indexGroups.reserve(count);
+	for (unsigned int it = 0; it < count; it++)
+	{
+		if (!help_chainable(store, it))
+			continue;
+
+		const double* parameters = store.parameters(it);
+		std::pair<std::unordered_map<Endpoint, int, EndpointHash>::iterator, bool> result =
+			indexGroups.insert(std::make_pair(Endpoint(parameters[0], parameters[1]), (int)indexGroups.size()));
+		groups[it] = result.first->second;
+	}
+
+	// Calculate the group ranges (every group ends with a sentinel slot)
+	unsigned int size = indexGroups.size();
+	indexBegin.assign(size + 1, 0);
+	for (unsigned int it = 0; it < count; it++)
+		if (groups[it] >= 0)
+			indexBegin[groups[it] + 1]++;
+	for (unsigned int group = 0; group < size; group++)
+		indexBegin[group + 1] += indexBegin[group] + 1;
+
+	// Fill the groups, in element order
+	indexMembers.assign(indexBegin[size], UINT_MAX);
+	indexSlot.assign(count, UINT_MAX);
+	vector<unsigned int> cursor(indexBegin.begin(), indexBegin.end() - 1);
+	for (unsigned int it = 0; it < count; it++)
+		if (groups[it] >= 0)
+		{
+			indexSlot[it] = cursor[groups[it]];
+			indexMembers[cursor[groups[it]]++] = it;
+		}
+
+	// Every member starts out unmerged
+	indexSkip.resize(indexMembers.size());
+	for (unsigned int member = 0; member < indexSkip.size(); member++)
+		indexSkip[member] = member;
+}
+
+// Find the group of a given start point (or -1)
+int Stitch::lookup(double x, double y) const
+{
+	std::unordered_map<Endpoint, int, EndpointHash>::const_iterator result = indexGroups.find(Endpoint(x, y));
+	if (result == indexGroups.end())
+		return -1;
+	return result->second;
+}
+
+// Find the first unmerged member of a group following a given element (or -1)
+int Stitch::find(int group, unsigned int position)
+{
+	// Bisect to the first member following the given element
+	unsigned int sentinel = indexBegin[group + 1] - 1;
+	unsigned int member = std::upper_bound(indexMembers.begin() + indexBegin[group], indexMembers.begin() + sentinel, position) - indexMembers.begin();
+
+	// Skip merged members
+	member = skip(member);
+	if (member == sentinel)
+		return -1;
+	return member;
+}
+
+// Find the first unmerged member of a group following a given element, within the partition ending at a given element (or -1)
+//   a failed search gets flagged as escaped if the group has members in later partitions
+int Stitch::find_local(int group, unsigned int position, unsigned int end, bool& escaped)
+{
+	// Bisect to the members following the given element, within the partition
+	unsigned int sentinel = indexBegin[group + 1] - 1;
+	unsigned int member = std::upper_bound(indexMembers.begin() + indexBegin[group], indexMembers.begin() + sentinel, position) - indexMembers.begin();
+	unsigned int last = std::lower_bound(indexMembers.begin() + member, indexMembers.begin() + sentinel, end) - indexMembers.begin();
+
+	// Skip merged members, without touching slots of other partitions
+	unsigned int root = member;
+	while (root < last && localSkip[root] != root)
+		root = localSkip[root];
+	while (member != root)
+	{
+		unsigned int next = localSkip[member];
+		localSkip[member] = root;
+		member = next;
+	}
+
+	if (root < last)
+		return root;
+	if (last < sentinel)
+		escaped = true;
+	return -1;
+}
+
+// Find the first unmerged member at or after a given one (with path compression)
+unsigned int Stitch::skip(unsigned int member)
+{
+	unsigned int root = member;
+	while (indexSkip[root] != root)
+		root = indexSkip[root];
+
+	while (indexSkip[member] != root)
+	{
+		unsigned int next = indexSkip[member];
+		indexSkip[member] = root;
+		member = next;
+	}
+
+	return root;
+}
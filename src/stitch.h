@@ -0,0 +1,178 @@
+/*
+ * stitch.h
+ * Inkpad polyline stitching.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Chaining rules
+ * ~~~~~~~~~~~~~~
+ *
+ * Elements get processed in order. Every element which hasn't been merged
+ * yet becomes the head of a chain, and scans all following elements: each
+ * point or polyline starting at the current end point of the chain gets
+ * merged, after which the scan continues with the new end point. As long
+ * as a scan made the chain grow, the head gets rescanned.
+ *
+ * Instead of comparing every element against all following ones, the start
+ * points of all elements get indexed in a hash map keyed on their exact
+ * coordinates. Every scan step then boils down to a hash lookup, and a
+ * search for the first unmerged element following the current one.
+ *
+ * Parallel chaining
+ * ~~~~~~~~~~~~~~~~~
+ *
+ * The elements get split into contiguous partitions, and every partition
+ * first gets chained on its own, in parallel, as if the other partitions
+ * didn't exist. A local chain is exactly the one the serial scan would
+ * produce, provided that (1) the partition looks the same as it did
+ * locally when the serial scan reaches the chain head, and (2) no failed
+ * search could have been satisfied by an element in a later partition.
+ *
+ * A sequential merge phase then replays the partitions in order, keeping
+ * track of the amount of elements whose merged state differs between the
+ * local and the global view. As long as both agree, local chains get
+ * committed as is; chains which could have escaped their partition, and
+ * chains processed while both views disagree (for example after a chain
+ * crossed a partition border), get rebuilt by the serial scan instead.
+ * The views converge again as soon as the local chain whose elements got
+ * taken over by a crossing chain has been passed, so only the chains
+ * around the borders need a serial rebuild.
+ *
+ * The result is identical to the serial scan for any amount of partitions.
+ * Local chains only touch the elements and index slots of their own
+ * partition, so no locking is needed.
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Include guard
+#ifndef __STITCH
+#define __STITCH
+
+// System headers
+#include <functional>
+
+// Application headers
+#include "exception.h"
+#include "store.h"
+#include "threading.h"
+
+// Containers
+#include <vector>
+#include <unordered_map>
+using std::vector;
+
+// Minimal amount of elements in a partition
+const unsigned int STITCH_PARTITION_MINIMUM = 4096;
+
+
+////////////////
+// DATA TYPES //
+////////////////
+
+// An exact end point
+struct Endpoint
+{
+	Endpoint(double _x, double _y) : x(_x), y(_y)
+	{
+	}
+
+	bool operator==(const Endpoint& other) const
+	{
+		return x == other.x && y == other.y;
+	}
+
+	double x;
+	double y;
+};
+
+// Hash function for end points (std::hash maps 0.0 and -0.0 alike)
+struct EndpointHash
+{
+	size_t operator()(const Endpoint& point) const
+	{
+		std::hash<double> hash;
+		return hash(point.x) * 31 + hash(point.y);
+	}
+};
+
+
+//////////////////////
+// CLASS DEFINITION //
+//////////////////////
+
+class Stitch
+{
+	public:
+		// Construction and destruction
+		Stitch(const Store&);
+
+		// Chaining
+		void search();
+		void search(unsigned int partitions);
+
+		// Results
+		bool merged(unsigned int) const;
+		const vector<char>& merged() const;
+		int next(unsigned int) const;
+
+	private:
+		// Chaining
+		void chain(unsigned int head, unsigned int end, bool local);
+		void replay(unsigned int begin, unsigned int end);
+
+		// Index
+		void index();
+		int lookup(double x, double y) const;
+		int find(int group, unsigned int position);
+		int find_local(int group, unsigned int position, unsigned int end, bool& escaped);
+		unsigned int skip(unsigned int);
+
+		// Input
+		const Store& store;
+
+		// Start point index (members of every group are stored contiguously, in element order)
+		std::unordered_map<Endpoint, int, EndpointHash> indexGroups;
+		vector<unsigned int> indexBegin;
+		vector<unsigned int> indexMembers;
+		vector<unsigned int> indexSkip;
+		vector<unsigned int> indexSlot;
+
+		// Chains
+		vector<char> chainMerged;
+		vector<int> chainNext;
+		vector<unsigned int> chainClaims;
+
+		// Partition-local chains
+		vector<char> localMerged;
+		vector<int> localNext;
+		vector<char> localEscaped;
+		vector<unsigned int> localSkip;
+};
+
+
+// Include guard
+#endif
@@ -0,0 +1,312 @@
+/*
+ * store.cpp
+ * Inkpad element storage.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Headers
+#include "store.h"
+#include <cstring>
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Construction and destruction
+//
+
+Store::Store()
+{
+}
+
+void Store::clear()
+{
+	storePoints.clear();
+	storeOffset.clear();
+	storeLength.clear();
+	storeType.clear();
+	storeStyle.clear();
+	storeBounds.clear();
+}
+
+// Allocate room for a given amount of elements and parameters
+void Store::reserve(unsigned int elements, unsigned int parameters)
+{
+	storePoints.reserve(parameters);
+	storeOffset.reserve(elements);
+	storeLength.reserve(elements);
+	storeType.reserve(elements);
+	storeStyle.reserve(elements);
+	storeBounds.reserve(elements);
+}
+
+
+//
+// Element access
+//
+
+// The amount of elements
+unsigned int Store::size() const
+{
+	return storeType.size();
+}
+
+bool Store::empty() const
+{
+	return storeType.empty();
+}
+
+// Properties of a single element
+int Store::identifier(unsigned int position) const
+{
+	return storeType[position];
+}
+
+const Style& Store::style(unsigned int position) const
+{
+	return storeStyle[position];
+}
+
+unsigned int Store::length(unsigned int position) const
+{
+	return storeLength[position];
+}
+
+const Bounds& Store::bounds(unsigned int position) const
+{
+	return storeBounds[position];
+}
+
+// Parameters of a single element (contiguous, interleaved x/y)
+double* Store::parameters(unsigned int position)
+{
+	return &storePoints[0] + storeOffset[position];
+}
+
+const double* Store::parameters(unsigned int position) const
+{
+	return &storePoints[0] + storeOffset[position];
+}
+
+// Construct a view on a single element
+Element Store::element(unsigned int position) const
+{
+	Element view;
+	view.identifier = storeType[position];
+	view.parameters = Parameters(storePoints.empty() ? 0 : parameters(position), storeLength[position]);
+	view.foreground = storeStyle[position].foreground;
+	view.background = storeStyle[position].background;
+	view.width = storeStyle[position].width;
+	return view;
+}
+
+
+//
+// Element modification
+//
+
+// Append an element
+void Store::push_back(int identifier, const double* points, unsigned int count, const Style& style)
+{
+	insert(storeType.size());
+	set(storeType.size() - 1, identifier, points, count, style);
+}
+
+// Insert an empty element before a given position
+void Store::insert(unsigned int position)
+{
+	storeOffset.insert(storeOffset.begin() + position, storePoints.size());
+	storeLength.insert(storeLength.begin() + position, 0);
+	storeType.insert(storeType.begin() + position, 0);
+	storeStyle.insert(storeStyle.begin() + position, Style());
+	storeBounds.insert(storeBounds.begin() + position, Bounds());
+}
+
+// Overwrite an existing element
+void Store::set(unsigned int position, int identifier, const double* points, unsigned int count, const Style& style)
+{
+	// Validate the type
+	if (identifier < 1 || identifier > 3)
+		throw Exception("store", "set", "unsupported element with ID " + stringify(identifier));
+
+	// Fits in the current range: overwrite in place
+	if (count <= storeLength[position])
+	{
+		if (count > 0)
+			memmove(parameters(position), points, count * sizeof(double));
+	}
+
+	// Doesn't fit: move the element to the end of the buffer
+	else
+	{
+		unsigned int offset = storePoints.size();
+		storePoints.insert(storePoints.end(), points, points + count);
+		storeOffset[position] = offset;
+	}
+
+	// Save the tables
+	storeLength[position] = count;
+	storeType[position] = identifier;
+	storeStyle[position] = style;
+	refresh(position);
+}
+
+// Overwrite an existing element with fresh, uninitialised parameters at the end of the buffer
+//   (its former parameters stay in place until the next compaction, and it needs a refresh once filled)
+void Store::allocate(unsigned int position, int identifier, unsigned int count, const Style& style)
+{
+	// Validate the type
+	if (identifier < 1 || identifier > 3)
+		throw Exception("store", "allocate", "unsupported element with ID " + stringify(identifier));
+
+	// Extend the buffer
+	storeOffset[position] = storePoints.size();
+	storePoints.resize(storePoints.size() + count);
+
+	// Save the tables
+	storeLength[position] = count;
+	storeType[position] = identifier;
+	storeStyle[position] = style;
+	storeBounds[position] = Bounds();
+}
+
+// Reduce the length of an element (in place, safe to call concurrently on distinct elements)
+void Store::shrink(unsigned int position, unsigned int count)
+{
+	if (count > storeLength[position])
+		throw Exception("store", "shrink", "cannot grow an element (" + stringify(count) + ">" + stringify(storeLength[position]) + ")");
+	storeLength[position] = count;
+	refresh(position);
+}
+
+// Overwrite the bounding box of an element (safe to call concurrently on distinct elements)
+void Store::bounds(unsigned int position, const Bounds& box)
+{
+	storeBounds[position] = box;
+}
+
+// Recalculate the bounding box of an element (safe to call concurrently on distinct elements)
+void Store::refresh(unsigned int position)
+{
+	Bounds box;
+	if (storeLength[position] > 0)
+	{
+		const double* points = parameters(position);
+		for (unsigned int i = 0; i+1 < storeLength[position]; i+=2)
+			box.add(points[i], points[i+1]);
+	}
+	storeBounds[position] = box;
+}
+
+// Remove a single element
+void Store::erase(unsigned int position)
+{
+	storeOffset.erase(storeOffset.begin() + position);
+	storeLength.erase(storeLength.begin() + position);
+	storeType.erase(storeType.begin() + position);
+	storeStyle.erase(storeStyle.begin() + position);
+	storeBounds.erase(storeBounds.begin() + position);
+}
+
+// Remove all marked elements in a single pass
+void Store::erase(const vector<char>& selection)
+{
+	unsigned int target = 0;
+	for (unsigned int i = 0; i < storeType.size(); i++)
+	{
+		if (selection[i])
+			continue;
+
+		storeOffset[target] = storeOffset[i];
+		storeLength[target] = storeLength[i];
+		storeType[target] = storeType[i];
+		storeStyle[target] = storeStyle[i];
+		storeBounds[target] = storeBounds[i];
+		target++;
+	}
+
+	storeOffset.resize(target);
+	storeLength.resize(target);
+	storeType.resize(target);
+	storeStyle.resize(target);
+	storeBounds.resize(target);
+}
+
+// Reclaim unused ranges, and restore element order within the buffer
+void Store::compact()
+{
+	// Calculate the amount of used parameters
+	unsigned int used = 0;
+	for (unsigned int i = 0; i < storeLength.size(); i++)
+		used += storeLength[i];
+	if (used == storePoints.size())
+		return;
+
+	// Copy all elements into a fresh buffer
+	vector<double> points;
+	points.reserve(used);
+	for (unsigned int i = 0; i < storeType.size(); i++)
+	{
+		unsigned int offset = points.size();
+		points.insert(points.end(), storePoints.begin() + storeOffset[i], storePoints.begin() + storeOffset[i] + storeLength[i]);
+		storeOffset[i] = offset;
+	}
+	storePoints.swap(points);
+}
+
+// Exchange contents with another store
+void Store::swap(Store& other)
+{
+	storePoints.swap(other.storePoints);
+	storeOffset.swap(other.storeOffset);
+	storeLength.swap(other.storeLength);
+	storeType.swap(other.storeType);
+	storeStyle.swap(other.storeStyle);
+	storeBounds.swap(other.storeBounds);
+}
+
+
+//
+// Coordinate buffer access
+//
+
+double* Store::coordinates()
+{
+	return storePoints.empty() ? 0 : &storePoints[0];
+}
+
+const double* Store::coordinates() const
+{
+	return storePoints.empty() ? 0 : &storePoints[0];
+}
+
+unsigned int Store::coordinates_size() const
+{
+	return storePoints.size();
+}
@@ -0,0 +1,306 @@
+/*
+ * store.h
+ * Inkpad element storage.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Storage layout
+ * ~~~~~~~~~~~~~~
+ *
+ * All coordinates of all elements are packed into a single contiguous
+ * buffer of interleaved x/y values. Every element is described by an entry
+ * in a set of parallel tables: its offset and length within the coordinate
+ * buffer, its type identifier and its pen style.
+ *
+ * Elements which get replaced by a larger set of parameters are moved to
+ * the end of the buffer, leaving their old range unused. Such ranges still
+ * get processed by whole-buffer transformations (which is harmless), and
+ * are reclaimed by compact().
+ *
+ * Every element also carries the bounding box of its parameters. All
+ * modifications keep it up to date, except for writes through parameters()
+ * or coordinates(), after which refresh() (or an explicit box, if it can be
+ * derived cheaply) must follow.
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Include guard
+#ifndef __STORE
+#define __STORE
+
+// System headers
+#include <string>
+#include <cstdio>
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+#include <wx/wx.h>
+#endif
+
+// Application headers
+#include "exception.h"
+#include "generic.h"
+#include "transform.h"
+
+// Containers
+#include <vector>
+using std::vector;
+
+
+////////////////
+// DATA TYPES //
+////////////////
+
+// A colour
+struct Colour
+{
+	Colour()
+	{
+	}
+	Colour(int _r, int _g, int _b) : r(_r), g(_g), b(_b)
+	{
+	}
+
+	std::string rgb_hex() const
+	{
+		std::string hex = "#";
+		char buffer[3];
+		sprintf(buffer, "%.2X", r);
+		hex += buffer;
+		sprintf(buffer, "%.2X", g);
+		hex += buffer;
+		sprintf(buffer, "%.2X", b);
+		hex += buffer;
+		return hex;
+	}
+
+	wxColor rgb_wxColor() const
+	{
+		wxColor wx(r, g, b);
+		return wx;
+	}
+
+	int r;
+	int g;
+	int b;
+};
+
+// The pen style of an element
+struct Style
+{
+	Colour foreground;
+	Colour background;
+	int width;
+};
+
+// A read-only view on the parameters of an element
+class Parameters
+{
+	public:
+		// Construction
+		Parameters() : dataBegin(0), dataSize(0)
+		{
+		}
+		Parameters(const double* _begin, unsigned int _size) : dataBegin(_begin), dataSize(_size)
+		{
+		}
+
+		// Access
+		const double& operator[](unsigned int i) const
+		{
+			return dataBegin[i];
+		}
+		unsigned int size() const
+		{
+			return dataSize;
+		}
+		bool empty() const
+		{
+			return dataSize == 0;
+		}
+		const double* begin() const
+		{
+			return dataBegin;
+		}
+		const double* end() const
+		{
+			return dataBegin + dataSize;
+		}
+
+	private:
+		const double* dataBegin;
+		unsigned int dataSize;
+};
+
+// The structure (a view on an element within the store)
+struct Element
+{
+	// Data
+	int identifier;
+	Parameters parameters;
+	Colour foreground;
+	Colour background;
+	int width;
+};
+
+/*
+ * Possible elements
+ *
+ * - ID 1: a point
+ *   params: x value, y value
+ *
+ * - ID 2: a (poly)line
+ *   params: x start value, y start value, {x point value, y point value}(n times), x end value, y end value
+ *
+ * - ID 3: a polybezier curve
+ *   params: {x start value, y start value, x control point 1, y control point 1, x control point 2, y control point 2, x end point, y end point}(n times)
+ *
+ */
+
+
+//////////////////////
+// CLASS DEFINITION //
+//////////////////////
+
+class Store
+{
+	public:
+		// Construction and destruction
+		Store();
+		void clear();
+		void reserve(unsigned int elements, unsigned int parameters);
+
+		// Element access
+		unsigned int size() const;
+		bool empty() const;
+		int identifier(unsigned int) const;
+		const Style& style(unsigned int) const;
+		unsigned int length(unsigned int) const;
+		const Bounds& bounds(unsigned int) const;
+		double* parameters(unsigned int);
+		const double* parameters(unsigned int) const;
+		Element element(unsigned int) const;
+
+		// Element modification
+		void push_back(int identifier, const double*, unsigned int, const Style&);
+		void insert(unsigned int);
+		void set(unsigned int, int identifier, const double*, unsigned int, const Style&);
+		void allocate(unsigned int, int identifier, unsigned int, const Style&);
+		void shrink(unsigned int, unsigned int);
+		void bounds(unsigned int, const Bounds&);
+		void refresh(unsigned int);
+		void erase(unsigned int);
+		void erase(const vector<char>&);
+		void compact();
+		void swap(Store&);
+
+		// Coordinate buffer access (includes unused ranges, see above)
+		double* coordinates();
+		const double* coordinates() const;
+		unsigned int coordinates_size() const;
+
+		// Iterators
+		class const_iterator
+		{
+			public:
+				const_iterator() : store(0), position(0)
+				{
+				}
+				const_iterator(const Store* _store, unsigned int _position) : store(_store), position(_position)
+				{
+				}
+
+				const Element& operator*() const
+				{
+					view = store->element(position);
+					return view;
+				}
+				const Element* operator->() const
+				{
+					view = store->element(position);
+					return &view;
+				}
+
+				const_iterator& operator++()
+				{
+					++position;
+					return *this;
+				}
+				const_iterator operator++(int)
+				{
+					const_iterator old = *this;
+					++position;
+					return old;
+				}
+				const_iterator& operator--()
+				{
+					--position;
+					return *this;
+				}
+
+				bool operator==(const const_iterator& other) const
+				{
+					return position == other.position;
+				}
+				bool operator!=(const const_iterator& other) const
+				{
+					return position != other.position;
+				}
+
+				unsigned int index() const
+				{
+					return position;
+				}
+
+			private:
+				const Store* store;
+				unsigned int position;
+				mutable Element view;
+		};
+		const_iterator begin() const
+		{
+			return const_iterator(this, 0);
+		}
+		const_iterator end() const
+		{
+			return const_iterator(this, storeType.size());
+		}
+
+	private:
+		// Coordinates
+		vector<double> storePoints;
+
+		// Element tables
+		vector<unsigned int> storeOffset;
+		vector<unsigned int> storeLength;
+		vector<int> storeType;
+		vector<Style> storeStyle;
+		vector<Bounds> storeBounds;
+};
+
+
+// Include guard
+#endif
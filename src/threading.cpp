@@ -37,4 +37,302 @@
 
 // Headers
 #include "threading.h"
+#include <exception>
+#include <chrono>
 
+// Nesting depth of parallel loops in the current thread (pool threads always are nested)
+static thread_local unsigned int threadDepth = 0;
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Construction and destruction
+//
+
+Pool::Pool(unsigned int threads)
+{
+	#ifdef WITH_THREADS
+	poolQueued = 0;
+	poolSleeping = 0;
+	start(threads);
+	#endif
+}
+
+Pool::~Pool()
+{
+	#ifdef WITH_THREADS
+	stop();
+	#endif
+}
+
+// The pool shared by the whole application (one thread per processor)
+Pool& Pool::instance()
+{
+	#ifdef WITH_THREADS
+	static Pool pool(std::max(std::thread::hardware_concurrency(), 1u));
+	#else
+	static Pool pool(1);
+	#endif
+	return pool;
+}
+
+
+//
+// Configuration
+//
+
+unsigned int Pool::size() const
+{
+	#ifdef WITH_THREADS
+	return poolQueues.size();
+	#else
+	return 1;
+	#endif
+}
+
+// Change the amount of threads (mustn't be called while processing a parallel loop)
+void Pool::resize(unsigned int threads)
+{
+	#ifdef WITH_THREADS
+	threads = std::max(threads, 1u);
+	if (threads == size())
+		return;
+	stop();
+	start(threads);
+	#endif
+}
+
+
+//
+// Parallel loops
+//
+
+// Process a range of chunks
+void Pool::parallel_for(unsigned int count, const std::function<void (unsigned int, unsigned int)>& body, bool split)
+{
+	if (count == 0)
+		return;
+
+	#ifdef WITH_THREADS
+	if (count > 1 && size() > 1 && threadDepth == 0)
+	{
+		threadDepth++;
+
+		// Set up the loop
+		Job job;
+		job.body = &body;
+		job.split = split;
+		job.remaining = count;
+		job.done = false;
+		job.failed = false;
+
+		// Hand every thread a contiguous share of the chunks
+		unsigned int shares = std::min(count, size());
+		for (unsigned int i = 0; i < shares; i++)
+		{
+			Task task = {&job, (unsigned int) ((unsigned long long) count * i / shares), (unsigned int) ((unsigned long long) count * (i + 1) / shares)};
+			push(i, task);
+		}
+
+		// Take part in the work, until all chunks are done
+		Task task;
+		while (!job.done)
+		{
+			if (acquire(0, task))
+				execute(0, task);
+			else
+			{
+				std::unique_lock<std::mutex> guard(job.lock);
+				job.wake.wait_for(guard, std::chrono::milliseconds(1), [&job]() { return job.done.load(); });
+			}
+		}
+
+		// The thread completing the last chunk might still be signalling
+		{
+			std::lock_guard<std::mutex> guard(job.lock);
+		}
+
+		threadDepth--;
+		if (job.error)
+			std::rethrow_exception(job.error);
+		return;
+	}
+	#endif
+
+	// Serial processing
+	threadDepth++;
+	try
+	{
+		body(0, count);
+	}
+	catch (...)
+	{
+		threadDepth--;
+		throw;
+	}
+	threadDepth--;
+}
+
+// Whether the current thread is processing a parallel loop
+bool Pool::active()
+{
+	return threadDepth > 0;
+}
+
+
+#ifdef WITH_THREADS
+
+//
+// Scheduling
+//
+
+// Push a task onto the bottom of a deque
+void Pool::push(unsigned int queue, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> guard(poolQueues[queue]->lock);
+		poolQueues[queue]->tasks.push_back(task);
+		poolQueued++;
+	}
+
+	// Wake up a sleeping thread
+	if (poolSleeping > 0)
+	{
+		std::lock_guard<std::mutex> guard(poolLock);
+		poolWake.notify_one();
+	}
+}
+
+// Fetch a task from the bottom of a deque, or steal one from the top of another deque
+bool Pool::acquire(unsigned int queue, Task& task)
+{
+	if (poolQueued == 0)
+		return false;
+
+	unsigned int count = poolQueues.size();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Queue* victim = poolQueues[(queue + i) % count];
+		std::lock_guard<std::mutex> guard(victim->lock);
+		if (victim->tasks.empty())
+			continue;
+
+		if (i == 0)
+		{
+			task = victim->tasks.back();
+			victim->tasks.pop_back();
+		}
+		else
+		{
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+		}
+		poolQueued--;
+		return true;
+	}
+
+	return false;
+}
+
+// Process a task
+void Pool::execute(unsigned int queue, Task& task)
+{
+	Job* job = task.job;
+
+	// Split off the upper halves, so other threads can steal them
+	if (job->split)
+	{
+		while (task.end - task.begin > 1)
+		{
+			unsigned int middle = task.begin + (task.end - task.begin) / 2;
+			Task half = {job, middle, task.end};
+			push(queue, half);
+			task.end = middle;
+		}
+	}
+
+	// Run the body (skipping the remaining work of a failed loop)
+	if (!job->failed)
+	{
+		try
+		{
+			(*job->body)(task.begin, task.end);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> guard(job->lock);
+			if (!job->error)
+				job->error = std::current_exception();
+			job->failed = true;
+		}
+	}
+
+	// Signal the completion of the last chunks (the job mustn't be touched afterwards)
+	unsigned int size = task.end - task.begin;
+	if (job->remaining.fetch_sub(size) == size)
+	{
+		std::lock_guard<std::mutex> guard(job->lock);
+		job->done = true;
+		job->wake.notify_all();
+	}
+}
+
+// Main loop of a pool thread
+void Pool::work(unsigned int queue)
+{
+	threadDepth = 1;
+
+	Task task;
+	while (true)
+	{
+		if (acquire(queue, task))
+		{
+			execute(queue, task);
+			continue;
+		}
+
+		// Sleep until there's work
+		std::unique_lock<std::mutex> guard(poolLock);
+		poolSleeping++;
+		poolWake.wait(guard, [this]() { return poolStop || poolQueued > 0; });
+		poolSleeping--;
+		if (poolStop)
+			return;
+	}
+}
+
+
+//
+// Threads
+//
+
+void Pool::start(unsigned int threads)
+{
+	poolStop = false;
+	for (unsigned int i = 0; i < threads; i++)
+		poolQueues.push_back(new Queue);
+	for (unsigned int i = 1; i < threads; i++)
+		poolThreads.push_back(std::thread(&Pool::work, this, i));
+}
+
+void Pool::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(poolLock);
+		poolStop = true;
+	}
+	poolWake.notify_all();
+
+	for (unsigned int i = 0; i < poolThreads.size(); i++)
+		poolThreads[i].join();
+	poolThreads.clear();
+
+	for (unsigned int i = 0; i < poolQueues.size(); i++)
+		delete poolQueues[i];
+	poolQueues.clear();
+}
+
+#endif
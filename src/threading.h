@@ -28,18 +28,34 @@
  */
 
 /*
- * Important note
- * ~~~~~~~~~~~~~~
+ * Thread pool
+ * ~~~~~~~~~~~
  *
- * When using the thread library to process a container which gets altered
- * during the processing, two things have to be kept in mind:
- *     1) The construction of the Thread object has to be barried, in order
- *        to get evenly distributed slices originating from identical
- *        iterators;
- *     2) The Thread.begin iterator _mustn't_ be erased, as it equals to
- *        the Thread.end iterator of another thread and will probably cause
- *        invalid reads (memory contents can get altered though, the iterator
- *        should just be kept valid).
+ * All parallel work runs on a single, persistent pool of threads, so no
+ * team of threads has to be started up for every operation. A parallel
+ * loop gets split into a contiguous range of chunks per thread, which are
+ * pushed onto per-thread deques. Every thread works on the bottom of its
+ * own deque, splitting its range in halves as it goes (so the other half
+ * is available to others), and an idle thread steals the oldest, largest
+ * range off the top of another deque. This balances the load even when
+ * chunks differ wildly in cost, as strokes of different lengths do.
+ *
+ * The thread calling a parallel loop takes part in the work. Loops started
+ * from within a parallel loop run serially in the calling thread.
+ *
+ *
+ * Partitioning
+ * ~~~~~~~~~~~~
+ *
+ * A Partitioner maps a range of indices onto chunks of (at least) a given
+ * grain size, and runs them on the pool. The chunks get distributed:
+ *     - statically: every thread processes its contiguous share of the
+ *       chunks in a single call, unless another thread steals it as a
+ *       whole, suitable for uniform work (e.g. transforming coordinates);
+ *     - dynamically: ranges get split down to single chunks, suitable for
+ *       work of varying size (e.g. processing elements of different
+ *       lengths).
+ * Ranges below the serial cutoff run in the calling thread in a single call.
  */
 
 ///////////////////
@@ -54,188 +70,161 @@
 #ifndef __THREADING
 #define __THREADING
 
-// Multithreading
-#ifdef WITH_OPENMP
-#include <omp.h>
+// System headers
 #include <algorithm>
+#include <functional>
+#include <deque>
+#ifdef WITH_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 #endif
 
+// Containers
+#include <vector>
+using std::vector;
 
 
-////////////
-// MACROS //
-////////////
-
-#ifdef WITH_OPENMP
-#define PARALLEL _Pragma("omp parallel")
-#else
-#define PARALLEL
-#endif
+////////////////
+// DATA TYPES //
+////////////////
 
+// Distribution of chunks over threads
+enum Schedule
+{
+	SCHEDULE_STATIC,
+	SCHEDULE_DYNAMIC
+};
 
 
 //////////////////////
 // CLASS DEFINITION //
 //////////////////////
 
-template <class T>
-class Thread
+class Pool
 {
-    public:
-        // Construction and destruction
-        Thread(T& inputContainer);
-        ~Thread();
-
-        // Iterators
-        typename T::iterator begin;
-        typename T::iterator end;
-        typename T::iterator nearend;
-
-        // Debugging routines
-        #ifndef NDEBUG
-        int dbgThreadCount();
-        int dbgThreadNumber();
-        bool dbgMultithreaded();
-        #endif
-
-    private:
-        // Range calculation
-        void split_range(T& inputContainer);
-};
-
-
-////////////////////
-// CLASS ROUTINES //
-////////////////////
-
+	public:
+		// Construction and destruction
+		Pool(unsigned int threads);
+		~Pool();
 
-//
-// Construction and destruction
-//
+		// The pool shared by the whole application
+		static Pool& instance();
 
-template <class T>
-Thread<T>::Thread(T& inputContainer)
-{
-    // Split the range
-    split_range(inputContainer);
-}
+		// Configuration (the amount of threads includes the calling one)
+		unsigned int size() const;
+		void resize(unsigned int threads);
 
-template <class T>
-Thread<T>::~Thread()
-{
-}
+		// Process the chunks [0, count), by calling body(chunk_begin, chunk_end)
+		void parallel_for(unsigned int count, const std::function<void (unsigned int, unsigned int)>& body, bool split = true);
 
+		// Whether the current thread is processing a parallel loop
+		static bool active();
 
-//
-// Range calculation
-//
+	private:
+		#ifdef WITH_THREADS
+		// A parallel loop
+		struct Job
+		{
+			const std::function<void (unsigned int, unsigned int)>* body;
+			bool split;
+			std::atomic<unsigned int> remaining;
+			std::atomic<bool> done;
+			std::atomic<bool> failed;
+			std::mutex lock;
+			std::condition_variable wake;
+			std::exception_ptr error;
+		};
+
+		// A range of chunks of a parallel loop
+		struct Task
+		{
+			Job* job;
+			unsigned int begin, end;
+		};
 
-// Split the range without using OpenMP
-#ifndef WITH_OPENMP
-template <class T>
-void Thread<T>::split_range(T& inputContainer)
-{
-    // Return the complete range
-    begin = inputContainer.begin();
-    end = inputContainer.end();
-}
-#endif
+		// A deque of tasks, owned by a single thread (the first one is shared by all callers)
+		struct Queue
+		{
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+
+		// Scheduling
+		void push(unsigned int queue, const Task&);
+		bool acquire(unsigned int queue, Task&);
+		void execute(unsigned int queue, Task&);
+		void work(unsigned int queue);
+
+		// Threads
+		void start(unsigned int threads);
+		void stop();
+		vector<std::thread> poolThreads;
+		vector<Queue*> poolQueues;
+
+		// Sleeping threads
+		std::mutex poolLock;
+		std::condition_variable poolWake;
+		std::atomic<unsigned int> poolQueued;
+		std::atomic<unsigned int> poolSleeping;
+		bool poolStop;
+		#endif
+};
 
-// Split the range using OpenMP
-#ifdef WITH_OPENMP
-template <class T>
-void Thread<T>::split_range(T& inputContainer)
+class Partitioner
 {
-    // Calculate amount of threads
-    int thread_count = omp_get_num_threads();
-
-    // Single threaded work: return the complete range
-    if (thread_count == 1)
-    {
-        begin = inputContainer.begin();
-        end = inputContainer.end();
-        return;
-    }
-
-    // Multi threaded work, split the range
-    else
-    {
-        // Get current thread
-        int thread = omp_get_thread_num();
-
-        // Starting point
-        begin = inputContainer.begin();
-
-        // Fetch size
-        int size;
-        #pragma omp single copyprivate(size)
-        {
-            size = inputContainer.size();
-        }
-
-        // Calculate remainder and quotient
-		int remainder = size % thread_count;
-		int quotient = size / thread_count;
-
-        // Math
-		if (thread < remainder)
+	public:
+		// Construction and destruction
+		Partitioner(unsigned int inputGrain = 1, Schedule inputSchedule = SCHEDULE_DYNAMIC, unsigned int inputCutoff = 0)
+			: grain(std::max(inputGrain, 1u)), schedule(inputSchedule), cutoff(inputCutoff)
 		{
-			std::advance(begin, thread * (1 + quotient));
-			end = begin;
-			std::advance(end, quotient + 1);
 		}
-		else
-        {
-            std::advance(begin, remainder + thread * quotient);
-            end = begin;
-            std::advance(end, quotient);
-        }
-        nearend = end;
-        nearend--;
-		return;
-    }
 
-}
-#endif
+		// Configuration
+		unsigned int grain;
+		Schedule schedule;
+		unsigned int cutoff;
 
+		// Process the range [begin, end), by calling body(chunk_begin, chunk_end) on every chunk
+		template <class F>
+		void run(unsigned int begin, unsigned int end, F body) const;
 
-//
-// Debugging routines
-//
+		// Whether a range of a given size would get processed in parallel
+		bool parallel(unsigned int size) const;
+};
 
-#ifndef NDEBUG
 
-// Amount of threads
-template <class T>
-int Thread<T>::dbgThreadCount() {
-    #ifdef WITH_OPENMP
-    return omp_get_num_threads();
-    #else
-    return 1;
-    #endif
-}
+////////////////////
+// CLASS ROUTINES //
+////////////////////
 
-// Number of current thread
-template <class T>
-int Thread<T>::dbgThreadNumber() {
-    #ifdef WITH_OPENMP
-    return omp_get_thread_num();
-    #else
-    return 1;
-    #endif
+inline bool Partitioner::parallel(unsigned int size) const
+{
+	return size > cutoff && size > grain && Pool::instance().size() > 1 && !Pool::active();
 }
 
-// Check if multithreaded
-template <class T>
-bool Thread<T>::dbgMultithreaded() {
-    #ifdef WITH_OPENMP
-    return true;
-    #else
-    return false;
-    #endif
+template <class F>
+void Partitioner::run(unsigned int begin, unsigned int end, F body) const
+{
+	if (begin >= end)
+		return;
+
+	if (parallel(end - begin))
+	{
+		unsigned int chunks = (end - begin + grain - 1) / grain;
+		unsigned int size = grain;
+		Pool::instance().parallel_for(chunks, [&](unsigned int chunk_begin, unsigned int chunk_end)
+		{
+			body(begin + chunk_begin*size, std::min(end, begin + chunk_end*size));
+		}, schedule == SCHEDULE_DYNAMIC);
+		return;
+	}
+
+	body(begin, end);
 }
 
-#endif
 
 // Include guard
 #endif
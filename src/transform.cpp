@@ -0,0 +1,367 @@
+/*
+ * transform.cpp
+ * Inkpad coordinate transformations.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Headers
+#include "transform.h"
+#include <algorithm>
+
+// Vector kernels (compiled for specific instruction sets, selected at runtime)
+#if defined(WITH_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_SIMD
+#include <immintrin.h>
+#endif
+
+
+////////////////////
+// CLASS ROUTINES //
+////////////////////
+
+//
+// Elementary transformations
+//
+
+// Rotation over a given angle (in degrees) around the origin
+Affine Affine::rotation(double angle)
+{
+	// Multiples of 90 degrees map onto exact axis swaps
+	if (fmod(angle, 90) == 0)
+	{
+		static const double cosines[4] = {1, 0, -1, 0};
+		static const double sines[4] = {0, 1, 0, -1};
+		static const double sines_negated[4] = {0, -1, 0, 1};
+		int quadrant = ((int)fmod(angle / 90, 4) + 4) % 4;
+		return Affine(cosines[quadrant], sines_negated[quadrant], sines[quadrant], cosines[quadrant], 0, 0);
+	}
+
+	double angle_rad = angle / 180 * M_PI;
+	double c = cos(angle_rad);
+	double s = sin(angle_rad);
+	return Affine(c, -s, s, c, 0, 0);
+}
+
+// Translation
+Affine Affine::translation(double dx, double dy)
+{
+	return Affine(1, 0, 0, 1, dx, dy);
+}
+
+
+//
+// Bounds
+//
+
+Bounds Bounds::transform(const Affine& matrix) const
+{
+	if (!valid())
+		return *this;
+
+	Bounds result;
+	double corners[8] = {x0, y0, x1, y0, x0, y1, x1, y1};
+	transform_bounds(corners, 8, matrix, result);
+	return result;
+}
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+//
+// Scalar kernels
+//
+
+static void help_points_scalar(double* points, unsigned int count, const Affine& matrix)
+{
+	for (unsigned int i = 0; i < count; i+=2)
+	{
+		double x = points[i];
+		double y = points[i+1];
+		points[i] = matrix.xx*x + matrix.xy*y + matrix.x0;
+		points[i+1] = matrix.yx*x + matrix.yy*y + matrix.y0;
+	}
+}
+
+static void help_bounds_scalar(const double* points, unsigned int count, const Affine& matrix, Bounds& bounds)
+{
+	for (unsigned int i = 0; i < count; i+=2)
+	{
+		double x = matrix.xx*points[i] + matrix.xy*points[i+1] + matrix.x0;
+		double y = matrix.yx*points[i] + matrix.yy*points[i+1] + matrix.y0;
+		bounds.add(x, y);
+	}
+}
+
+
+//
+// Vector kernels
+//
+
+// Every point gets transformed as diagonal*(x, y) + cross*(y, x) + offset, which
+//   performs the same operations in the same order as the scalar kernel
+
+#ifdef TRANSFORM_SIMD
+
+// SSE2: one point at a time
+__attribute__((target("sse2")))
+static void help_points_sse2(double* points, unsigned int count, const Affine& matrix)
+{
+	__m128d diagonal = _mm_setr_pd(matrix.xx, matrix.yy);
+	__m128d cross = _mm_setr_pd(matrix.xy, matrix.yx);
+	__m128d offset = _mm_setr_pd(matrix.x0, matrix.y0);
+	for (unsigned int i = 0; i < count; i+=2)
+	{
+		__m128d point = _mm_loadu_pd(points + i);
+		__m128d swapped = _mm_shuffle_pd(point, point, 1);
+		_mm_storeu_pd(points + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(diagonal, point), _mm_mul_pd(cross, swapped)), offset));
+	}
+}
+
+__attribute__((target("sse2")))
+static void help_bounds_sse2(const double* points, unsigned int count, const Affine& matrix, Bounds& bounds)
+{
+	__m128d diagonal = _mm_setr_pd(matrix.xx, matrix.yy);
+	__m128d cross = _mm_setr_pd(matrix.xy, matrix.yx);
+	__m128d offset = _mm_setr_pd(matrix.x0, matrix.y0);
+	__m128d lower = _mm_setr_pd(bounds.x0, bounds.y0);
+	__m128d upper = _mm_setr_pd(bounds.x1, bounds.y1);
+	for (unsigned int i = 0; i < count; i+=2)
+	{
+		__m128d point = _mm_loadu_pd(points + i);
+		__m128d swapped = _mm_shuffle_pd(point, point, 1);
+		__m128d result = _mm_add_pd(_mm_add_pd(_mm_mul_pd(diagonal, point), _mm_mul_pd(cross, swapped)), offset);
+		lower = _mm_min_pd(lower, result);
+		upper = _mm_max_pd(upper, result);
+	}
+
+	double values[4];
+	_mm_storeu_pd(values, lower);
+	_mm_storeu_pd(values + 2, upper);
+	bounds.x0 = values[0];
+	bounds.y0 = values[1];
+	bounds.x1 = values[2];
+	bounds.y1 = values[3];
+}
+
+// AVX2: two points at a time
+__attribute__((target("avx2")))
+static void help_points_avx2(double* points, unsigned int count, const Affine& matrix)
+{
+	__m256d diagonal = _mm256_setr_pd(matrix.xx, matrix.yy, matrix.xx, matrix.yy);
+	__m256d cross = _mm256_setr_pd(matrix.xy, matrix.yx, matrix.xy, matrix.yx);
+	__m256d offset = _mm256_setr_pd(matrix.x0, matrix.y0, matrix.x0, matrix.y0);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i+=4)
+	{
+		__m256d point = _mm256_loadu_pd(points + i);
+		__m256d swapped = _mm256_permute_pd(point, 5);
+		_mm256_storeu_pd(points + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(diagonal, point), _mm256_mul_pd(cross, swapped)), offset));
+	}
+	help_points_sse2(points + i, count - i, matrix);
+}
+
+__attribute__((target("avx2")))
+static void help_bounds_avx2(const double* points, unsigned int count, const Affine& matrix, Bounds& bounds)
+{
+	__m256d diagonal = _mm256_setr_pd(matrix.xx, matrix.yy, matrix.xx, matrix.yy);
+	__m256d cross = _mm256_setr_pd(matrix.xy, matrix.yx, matrix.xy, matrix.yx);
+	__m256d offset = _mm256_setr_pd(matrix.x0, matrix.y0, matrix.x0, matrix.y0);
+	__m256d lower = _mm256_setr_pd(bounds.x0, bounds.y0, bounds.x0, bounds.y0);
+	__m256d upper = _mm256_setr_pd(bounds.x1, bounds.y1, bounds.x1, bounds.y1);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i+=4)
+	{
+		__m256d point = _mm256_loadu_pd(points + i);
+		__m256d swapped = _mm256_permute_pd(point, 5);
+		__m256d result = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(diagonal, point), _mm256_mul_pd(cross, swapped)), offset);
+		lower = _mm256_min_pd(lower, result);
+		upper = _mm256_max_pd(upper, result);
+	}
+
+	// Fold both halves
+	double values[4];
+	_mm_storeu_pd(values, _mm_min_pd(_mm256_castpd256_pd128(lower), _mm256_extractf128_pd(lower, 1)));
+	_mm_storeu_pd(values + 2, _mm_max_pd(_mm256_castpd256_pd128(upper), _mm256_extractf128_pd(upper, 1)));
+	bounds.x0 = values[0];
+	bounds.y0 = values[1];
+	bounds.x1 = values[2];
+	bounds.y1 = values[3];
+	help_bounds_sse2(points + i, count - i, matrix, bounds);
+}
+
+// AVX-512: four points at a time
+__attribute__((target("avx512f")))
+static void help_points_avx512(double* points, unsigned int count, const Affine& matrix)
+{
+	__m512d diagonal = _mm512_setr_pd(matrix.xx, matrix.yy, matrix.xx, matrix.yy, matrix.xx, matrix.yy, matrix.xx, matrix.yy);
+	__m512d cross = _mm512_setr_pd(matrix.xy, matrix.yx, matrix.xy, matrix.yx, matrix.xy, matrix.yx, matrix.xy, matrix.yx);
+	__m512d offset = _mm512_setr_pd(matrix.x0, matrix.y0, matrix.x0, matrix.y0, matrix.x0, matrix.y0, matrix.x0, matrix.y0);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i+=8)
+	{
+		__m512d point = _mm512_loadu_pd(points + i);
+		__m512d swapped = _mm512_permute_pd(point, 0x55);
+		_mm512_storeu_pd(points + i, _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(diagonal, point), _mm512_mul_pd(cross, swapped)), offset));
+	}
+	help_points_avx2(points + i, count - i, matrix);
+}
+
+__attribute__((target("avx512f")))
+static void help_bounds_avx512(const double* points, unsigned int count, const Affine& matrix, Bounds& bounds)
+{
+	__m512d diagonal = _mm512_setr_pd(matrix.xx, matrix.yy, matrix.xx, matrix.yy, matrix.xx, matrix.yy, matrix.xx, matrix.yy);
+	__m512d cross = _mm512_setr_pd(matrix.xy, matrix.yx, matrix.xy, matrix.yx, matrix.xy, matrix.yx, matrix.xy, matrix.yx);
+	__m512d offset = _mm512_setr_pd(matrix.x0, matrix.y0, matrix.x0, matrix.y0, matrix.x0, matrix.y0, matrix.x0, matrix.y0);
+	__m512d lower = _mm512_setr_pd(bounds.x0, bounds.y0, bounds.x0, bounds.y0, bounds.x0, bounds.y0, bounds.x0, bounds.y0);
+	__m512d upper = _mm512_setr_pd(bounds.x1, bounds.y1, bounds.x1, bounds.y1, bounds.x1, bounds.y1, bounds.x1, bounds.y1);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i+=8)
+	{
+		__m512d point = _mm512_loadu_pd(points + i);
+		__m512d swapped = _mm512_permute_pd(point, 0x55);
+		__m512d result = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(diagonal, point), _mm512_mul_pd(cross, swapped)), offset);
+		lower = _mm512_min_pd(lower, result);
+		upper = _mm512_max_pd(upper, result);
+	}
+
+	// Fold all quarters
+	__m256d lower_half = _mm256_min_pd(_mm512_castpd512_pd256(lower), _mm512_extractf64x4_pd(lower, 1));
+	__m256d upper_half = _mm256_max_pd(_mm512_castpd512_pd256(upper), _mm512_extractf64x4_pd(upper, 1));
+	double values[4];
+	_mm_storeu_pd(values, _mm_min_pd(_mm256_castpd256_pd128(lower_half), _mm256_extractf128_pd(lower_half, 1)));
+	_mm_storeu_pd(values + 2, _mm_max_pd(_mm256_castpd256_pd128(upper_half), _mm256_extractf128_pd(upper_half, 1)));
+	bounds.x0 = values[0];
+	bounds.y0 = values[1];
+	bounds.x1 = values[2];
+	bounds.y1 = values[3];
+	help_bounds_avx2(points + i, count - i, matrix, bounds);
+}
+
+#endif
+
+
+//
+// Kernel selection
+//
+
+// The best instruction set supported by the processor
+TransformIsa transform_supported()
+{
+	#ifdef TRANSFORM_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return TRANSFORM_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return TRANSFORM_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return TRANSFORM_SSE2;
+	#endif
+	return TRANSFORM_SCALAR;
+}
+
+static TransformIsa& help_isa()
+{
+	static TransformIsa isa = transform_supported();
+	return isa;
+}
+
+TransformIsa transform_isa()
+{
+	return help_isa();
+}
+
+// Select an instruction set (limited to the supported ones)
+void transform_isa(TransformIsa isa)
+{
+	help_isa() = std::min(isa, transform_supported());
+}
+
+const char* transform_name(TransformIsa isa)
+{
+	switch (isa)
+	{
+		case TRANSFORM_SSE2:
+			return "sse2";
+		case TRANSFORM_AVX2:
+			return "avx2";
+		case TRANSFORM_AVX512:
+			return "avx512";
+		default:
+			return "scalar";
+	}
+}
+
+
+//
+// Kernels
+//
+
+// Transform a run of coordinates
+void transform_points(double* points, unsigned int count, const Affine& matrix)
+{
+	switch (help_isa())
+	{
+		#ifdef TRANSFORM_SIMD
+		case TRANSFORM_AVX512:
+			help_points_avx512(points, count, matrix);
+			break;
+		case TRANSFORM_AVX2:
+			help_points_avx2(points, count, matrix);
+			break;
+		case TRANSFORM_SSE2:
+			help_points_sse2(points, count, matrix);
+			break;
+		#endif
+		default:
+			help_points_scalar(points, count, matrix);
+			break;
+	}
+}
+
+// Extend a bounding box with a run of transformed coordinates
+void transform_bounds(const double* points, unsigned int count, const Affine& matrix, Bounds& bounds)
+{
+	switch (help_isa())
+	{
+		#ifdef TRANSFORM_SIMD
+		case TRANSFORM_AVX512:
+			help_bounds_avx512(points, count, matrix, bounds);
+			break;
+		case TRANSFORM_AVX2:
+			help_bounds_avx2(points, count, matrix, bounds);
+			break;
+		case TRANSFORM_SSE2:
+			help_bounds_sse2(points, count, matrix, bounds);
+			break;
+		#endif
+		default:
+			help_bounds_scalar(points, count, matrix, bounds);
+			break;
+	}
+}
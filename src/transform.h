@@ -0,0 +1,173 @@
+/*
+ * transform.h
+ * Inkpad coordinate transformations.
+ *
+ * Copyright (c) 2009 Tim Besard <tim.besard@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+///////////////////
+// CONFIGURATION //
+///////////////////
+
+//
+// Essential stuff
+//
+
+// Include guard
+#ifndef __TRANSFORM
+#define __TRANSFORM
+
+// System headers
+#include <cmath>
+#include <limits>
+
+// Amount of values processed at once when splitting up a coordinate buffer (must be even)
+const int TRANSFORM_BLOCK = 4096;
+
+
+////////////////
+// DATA TYPES //
+////////////////
+
+// Instruction sets the kernels can use (in increasing order of preference)
+enum TransformIsa
+{
+	TRANSFORM_SCALAR,
+	TRANSFORM_SSE2,
+	TRANSFORM_AVX2,
+	TRANSFORM_AVX512
+};
+
+// A 2x3 affine transformation matrix
+//   x' = xx*x + xy*y + x0
+//   y' = yx*x + yy*y + y0
+struct Affine
+{
+	Affine() : xx(1), xy(0), yx(0), yy(1), x0(0), y0(0)
+	{
+	}
+	Affine(double _xx, double _xy, double _yx, double _yy, double _x0, double _y0) : xx(_xx), xy(_xy), yx(_yx), yy(_yy), x0(_x0), y0(_y0)
+	{
+	}
+
+	// Elementary transformations
+	static Affine rotation(double angle);
+	static Affine translation(double dx, double dy);
+
+	// Composition (the given transformation gets applied first)
+	Affine operator*(const Affine& other) const
+	{
+		return Affine(
+			xx*other.xx + xy*other.yx, xx*other.xy + xy*other.yy,
+			yx*other.xx + yy*other.yx, yx*other.xy + yy*other.yy,
+			xx*other.x0 + xy*other.y0 + x0, yx*other.x0 + yy*other.y0 + y0);
+	}
+
+	// Linear part (without translation)
+	Affine linear() const
+	{
+		return Affine(xx, xy, yx, yy, 0, 0);
+	}
+
+	// Application
+	void apply(double& x, double& y) const
+	{
+		double xc = x;
+		x = xx*xc + xy*y + x0;
+		y = yx*xc + yy*y + y0;
+	}
+
+	bool identity() const
+	{
+		return xx == 1 && xy == 0 && yx == 0 && yy == 1 && x0 == 0 && y0 == 0;
+	}
+
+	// Whether axis-aligned boxes map onto axis-aligned boxes (scaling, translation, axis swaps)
+	bool rectilinear() const
+	{
+		return (xy == 0 && yx == 0) || (xx == 0 && yy == 0);
+	}
+
+	double xx, xy, yx, yy, x0, y0;
+};
+
+// An axis-aligned bounding box
+struct Bounds
+{
+	Bounds() : x0(std::numeric_limits<double>::infinity()), y0(std::numeric_limits<double>::infinity()),
+		x1(-std::numeric_limits<double>::infinity()), y1(-std::numeric_limits<double>::infinity())
+	{
+	}
+
+	void add(double x, double y)
+	{
+		if (x < x0) x0 = x;
+		if (x > x1) x1 = x;
+		if (y < y0) y0 = y;
+		if (y > y1) y1 = y;
+	}
+	void merge(const Bounds& other)
+	{
+		if (other.x0 < x0) x0 = other.x0;
+		if (other.x1 > x1) x1 = other.x1;
+		if (other.y0 < y0) y0 = other.y0;
+		if (other.y1 > y1) y1 = other.y1;
+	}
+
+	bool valid() const
+	{
+		return x0 <= x1 && y0 <= y1;
+	}
+
+	// Whether the box reaches the edge of an enclosing one
+	bool touches(const Bounds& other) const
+	{
+		return x0 <= other.x0 || y0 <= other.y0 || x1 >= other.x1 || y1 >= other.y1;
+	}
+
+	// Whether two boxes overlap (touching edges included)
+	bool intersects(const Bounds& other) const
+	{
+		return x0 <= other.x1 && other.x0 <= x1 && y0 <= other.y1 && other.y0 <= y1;
+	}
+
+	// The box enclosing the transformed corners (exact for rectilinear transformations)
+	Bounds transform(const Affine& matrix) const;
+
+	double x0, y0, x1, y1;
+};
+
+
+//////////////
+// ROUTINES //
+//////////////
+
+// Kernels over a contiguous run of interleaved x/y coordinates (count being the amount of values)
+//   all instruction sets produce bitwise identical results
+void transform_points(double* points, unsigned int count, const Affine& matrix);
+void transform_bounds(const double* points, unsigned int count, const Affine& matrix, Bounds& bounds);
+
+// Kernel selection (defaults to the best instruction set the processor supports)
+TransformIsa transform_supported();
+TransformIsa transform_isa();
+void transform_isa(TransformIsa);
+const char* transform_name(TransformIsa);
+
+
+// Include guard
+#endif